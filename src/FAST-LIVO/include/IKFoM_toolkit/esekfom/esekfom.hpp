@@ -102,6 +102,19 @@ struct dyn_runtime_share_datastruct
 	Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic> R;
 };
 
+//used for iterated error state EKF update
+//for the aim to calculate the normal equation of the measurement (h_x^T h_x, h_x^T h) at the same time, by only one function.
+//applied for measurements which only depend on the first h_cols dimensions of the state (e.g. the pose for point-to-plane residuals),
+//so that every matrix of the update has a size known at compile time.
+template<typename T, int h_cols>
+struct fixed_share_datastruct
+{
+	bool valid;
+	bool converge;
+	Eigen::Matrix<T, h_cols, h_cols> HTH;
+	Eigen::Matrix<T, h_cols, 1> HTh;
+};
+
 template<typename state, int process_noise_dof, typename input = state, typename measurement=state, int measurement_noise_dof=0>
 class esekf{
 
@@ -1927,6 +1940,152 @@ public:
 		}
 	}
 
+	//iterated error state EKF update for measurements only depending on the first h_cols dimensions of the state,
+	//with identical noise R for all measurements. The measurement model (h_fixed) reduces its Jacobian to
+	//h_x^T h_x and h_x^T h, so no dynamic or sparse matrix is needed. By the Woodbury identity
+	//(H^T H + (P/R)^-1)^-1 restricted to its first h_cols columns is P'.block<n, h_cols> * S^-1 * (S^-1 + H^T H)^-1,
+	//with P' = P/R and S = P'.block<h_cols, h_cols>, so each iteration costs one h_cols x h_cols LLT and LDLT.
+	template<int h_cols, typename measurementModel_fixed>
+	void update_iterated_fixed_share(double R, measurementModel_fixed h_fixed, double &solve_time) {
+
+		fixed_share_datastruct<scalar_type, h_cols> fixed_share;
+		fixed_share.valid = true;
+		fixed_share.converge = true;
+		int t = 0;
+		state x_propagated = x_;
+		cov P_propagated = P_;
+
+		Matrix<scalar_type, n, 1> K_h;
+		Matrix<scalar_type, n, h_cols> K_x;
+
+		vectorized_state dx_new = vectorized_state::Zero();
+		for(int i=-1; i<maximum_iter; i++)
+		{
+			fixed_share.valid = true;
+			h_fixed(x_, fixed_share);
+			double solve_start = omp_get_wtime();
+			vectorized_state dx;
+			x_.boxminus(dx, x_propagated);
+			dx_new = dx;
+
+			if(! fixed_share.valid)
+			{
+				continue;
+			}
+
+			P_ = P_propagated;
+
+			Matrix<scalar_type, 3, 3> res_temp_SO3;
+			MTK::vect<3, scalar_type> seg_SO3;
+			for (std::vector<std::pair<int, int> >::iterator it = x_.SO3_state.begin(); it != x_.SO3_state.end(); it++) {
+				int idx = (*it).first;
+				for(int i = 0; i < 3; i++){
+					seg_SO3(i) = dx(idx+i);
+				}
+
+				res_temp_SO3 = MTK::A_matrix(seg_SO3).transpose();
+				dx_new.template block<3, 1>(idx, 0) = res_temp_SO3 * dx_new.template block<3, 1>(idx, 0);
+				P_. template block<3, n>(idx, 0) = res_temp_SO3 * P_. template block<3, n>(idx, 0);
+				P_. template block<n, 3>(0, idx) = P_. template block<n, 3>(0, idx) * res_temp_SO3.transpose();
+			}
+
+			Matrix<scalar_type, 2, 2> res_temp_S2;
+			MTK::vect<2, scalar_type> seg_S2;
+			for (std::vector<std::pair<int, int> >::iterator it = x_.S2_state.begin(); it != x_.S2_state.end(); it++) {
+				int idx = (*it).first;
+				for(int i = 0; i < 2; i++){
+					seg_S2(i) = dx(idx + i);
+				}
+
+				Eigen::Matrix<scalar_type, 2, 3> Nx;
+				Eigen::Matrix<scalar_type, 3, 2> Mx;
+				x_.S2_Nx_yy(Nx, idx);
+				x_propagated.S2_Mx(Mx, seg_S2, idx);
+				res_temp_S2 = Nx * Mx;
+				dx_new.template block<2, 1>(idx, 0) = res_temp_S2 * dx_new.template block<2, 1>(idx, 0);
+				P_. template block<2, n>(idx, 0) = res_temp_S2 * P_. template block<2, n>(idx, 0);
+				P_. template block<n, 2>(0, idx) = P_. template block<n, 2>(0, idx) * res_temp_S2.transpose();
+			}
+
+			Matrix<scalar_type, n, h_cols> K_1;
+			LLT<Matrix<scalar_type, h_cols, h_cols> > llt(P_. template block<h_cols, h_cols>(0, 0) / R);
+			if(llt.info() == Success)
+			{
+				Matrix<scalar_type, h_cols, h_cols> S_inv = llt.solve(Matrix<scalar_type, h_cols, h_cols>::Identity());
+				Matrix<scalar_type, h_cols, n> S_inv_P = llt.solve(P_. template block<h_cols, n>(0, 0) / R);
+				LDLT<Matrix<scalar_type, h_cols, h_cols> > ldlt(S_inv + fixed_share.HTH);
+				K_1 = ldlt.solve(S_inv_P).transpose();
+			}
+			else
+			{
+				cov P_temp = (P_/R).inverse();
+				P_temp. template block<h_cols, h_cols>(0, 0) += fixed_share.HTH;
+				K_1 = P_temp.inverse(). template block<n, h_cols>(0, 0);
+			}
+			K_h = K_1 * fixed_share.HTh;
+			K_x = K_1 * fixed_share.HTH;
+
+			Matrix<scalar_type, n, 1> dx_ = K_h + K_x * dx_new. template block<h_cols, 1>(0, 0) - dx_new;
+			x_.boxplus(dx_);
+			fixed_share.converge = true;
+			for(int i = 0; i < n ; i++)
+			{
+				if(std::fabs(dx_[i]) > limit[i])
+				{
+					fixed_share.converge = false;
+					break;
+				}
+			}
+			if(fixed_share.converge) t++;
+
+			if(!t && i == maximum_iter - 2)
+			{
+				fixed_share.converge = true;
+			}
+
+			if(t > 1 || i == maximum_iter - 1)
+			{
+				L_ = P_;
+				Matrix<scalar_type, 3, 3> res_temp_SO3;
+				MTK::vect<3, scalar_type> seg_SO3;
+				for(typename std::vector<std::pair<int, int> >::iterator it = x_.SO3_state.begin(); it != x_.SO3_state.end(); it++) {
+					int idx = (*it).first;
+					for(int i = 0; i < 3; i++){
+						seg_SO3(i) = dx_(i + idx);
+					}
+					res_temp_SO3 = MTK::A_matrix(seg_SO3).transpose();
+					L_. template block<3, n>(idx, 0) = res_temp_SO3 * P_. template block<3, n>(idx, 0);
+					K_x. template block<3, h_cols>(idx, 0) = res_temp_SO3 * K_x. template block<3, h_cols>(idx, 0);
+					L_. template block<n, 3>(0, idx) = L_. template block<n, 3>(0, idx) * res_temp_SO3.transpose();
+					P_. template block<n, 3>(0, idx) = P_. template block<n, 3>(0, idx) * res_temp_SO3.transpose();
+				}
+
+				Matrix<scalar_type, 2, 2> res_temp_S2;
+				MTK::vect<2, scalar_type> seg_S2;
+				for(typename std::vector<std::pair<int, int> >::iterator it = x_.S2_state.begin(); it != x_.S2_state.end(); it++) {
+					int idx = (*it).first;
+					for(int i = 0; i < 2; i++){
+						seg_S2(i) = dx_(i + idx);
+					}
+					Eigen::Matrix<scalar_type, 2, 3> Nx;
+					Eigen::Matrix<scalar_type, 3, 2> Mx;
+					x_.S2_Nx_yy(Nx, idx);
+					x_propagated.S2_Mx(Mx, seg_S2, idx);
+					res_temp_S2 = Nx * Mx;
+					L_. template block<2, n>(idx, 0) = res_temp_S2 * P_. template block<2, n>(idx, 0);
+					K_x. template block<2, h_cols>(idx, 0) = res_temp_S2 * K_x. template block<2, h_cols>(idx, 0);
+					L_. template block<n, 2>(0, idx) = L_. template block<n, 2>(0, idx) * res_temp_S2.transpose();
+					P_. template block<n, 2>(0, idx) = P_. template block<n, 2>(0, idx) * res_temp_S2.transpose();
+				}
+
+				P_ = L_ - K_x * P_. template block<h_cols, n>(0, 0);
+				solve_time += omp_get_wtime() - solve_start;
+				return;
+			}
+			solve_time += omp_get_wtime() - solve_start;
+		}
+	}
+
 	void change_x(state &input_state)
 	{
 		x_ = input_state;
@@ -26,6 +26,7 @@
 #include <sensor_msgs/PointCloud2.h>
 #include <fast_livo/States.h>
 #include <geometry_msgs/Vector3.h>
+#include "task_scheduler.h"
 
 #ifdef USE_IKFOM
 #include "use-ikfom.hpp"
@@ -37,6 +38,22 @@
 
 const bool time_list(PointType &x, PointType &y); //{return (x.curvature < y.curvature);};
 
+//; 去畸变时每个点的旋转: 精确的 R_imu * Exp(w * dt)，或二阶展开 R_imu * (I + [w dt]x + [w dt]x^2 / 2)
+enum UNDISTORT_MODE{UNDISTORT_EXACT = 0, UNDISTORT_APPROX = 1};
+#define UNDISTORT_CHUNK (256) //; 每个并行任务最多处理的点数
+
+//; 上一帧最后一个IMU + 这一帧的IMU，只是引用，不拷贝deque
+struct ImuSpan
+{
+    const sensor_msgs::ImuConstPtr &first;
+    const deque<sensor_msgs::ImuConstPtr> &rest;
+    ImuSpan(const sensor_msgs::ImuConstPtr &first_imu, const deque<sensor_msgs::ImuConstPtr> &imus) : first(first_imu), rest(imus) {}
+    int size() const { return rest.size() + 1; }
+    const sensor_msgs::ImuConstPtr &operator[](int k) const { return k == 0 ? first : rest[k - 1]; }
+    const sensor_msgs::ImuConstPtr &front() const { return first; }
+    const sensor_msgs::ImuConstPtr &back() const { return rest.empty() ? first : rest.back(); }
+};
+
 /// *************IMU Process and undistortion
 class ImuProcess
 {
@@ -56,6 +73,9 @@ public:
     void set_acc_cov_scale(const V3D &scaler);
     void set_gyr_bias_cov(const V3D &b_g);
     void set_acc_bias_cov(const V3D &b_a);
+    void set_undistort_mode(int mode) { undistort_mode = mode; }
+    void set_scheduler(TaskScheduler *scheduler_param) { scheduler = scheduler_param; } //; 去畸变的并行段用的线程池
+    double get_acc_scale() const { return G_m_s2 / mean_acc.norm(); } //; 加速度计读数换算到m/s^2的比例
 #ifdef USE_IKFOM
     Eigen::Matrix<double, 12, 12> Q;
     void Process(const MeasureGroup &meas, esekfom::esekf<state_ikfom, 12, input_ikfom> &kf_state, PointCloudXYZI::Ptr pcl_un_);
@@ -74,6 +94,7 @@ public:
     V3D cov_bias_gyr;
     V3D cov_bias_acc;
     double first_lidar_time;
+    double undistort_time; //; 上一帧去畸变的时间
 
 private:
 #ifdef USE_IKFOM    //微分流形上的卡尔曼滤波
@@ -83,6 +104,21 @@ private:
     void IMU_init(const MeasureGroup &meas, StatesGroup &state, int &N);
     void Forward(const MeasureGroup &meas, StatesGroup &state_inout, double pcl_beg_time, double end_time);
     void Backward(const LidarMeasureGroup &lidar_meas, StatesGroup &state_inout, PointCloudXYZI &pcl_out);
+    void undistort_points(const StatesGroup &state, PointCloudXYZI &pcl_out);
+
+    //; 相邻两个IMU位姿之间的一段，段内的点共用同一组变换系数
+    struct UndistortSegment
+    {
+        int head;              //; IMUpose里的下标
+        M3D A;                 //; R_end^T * R_imu
+        V3D b, vel, acc, gyr;  //; R_end^T * (pos_imu - pos_liD_e)，R_end^T * vel，R_end^T * acc，角速度
+    };
+    struct UndistortTask
+    {
+        int seg, beg, end;     //; 点的下标范围 [beg, end)
+    };
+    vector<UndistortSegment> undist_segs;
+    vector<UndistortTask> undist_tasks;
 #endif
 
     PointCloudXYZI::Ptr cur_pcl_un_;
@@ -103,5 +139,7 @@ private:
     int init_iter_num = 1;
     bool b_first_frame_ = true;
     bool imu_need_init_ = true;
+    int undistort_mode;
+    TaskScheduler *scheduler;
 };
 #endif
@@ -27,6 +27,9 @@ using namespace Sophus;
 // #define USE_ikdforest
 // #define USE_IKFOM
 // #define USE_FOV_Checker
+// #define PLANE_FIT_CHECK   // 批量平面拟合的结果和QR逐个对比
+// #define COV_PROPAGATION_CHECK   // 块稀疏的IMU协方差传播和稠密的F*P*F^T对比
+// #define INFO_SOLVE_CHECK   // 信息形式的卡尔曼增益和两次18x18求逆的结果对比
 
 #define print_line std::cout << __FILE__ << ", " << __LINE__ << std::endl;
 #define PI_M (3.14159265358)
@@ -439,6 +442,113 @@ struct StatesGroup
     Matrix<double, DIM_STATE, DIM_STATE> cov; // states covariance
 };
 
+/* comment
+IEKF的信息形式更新 K_1 = (H^T H + (P/c)^-1)^-1，H只有前6列(位姿)非零，所以只用到K_1的前6列。
+记 P' = P/c，S = P'的左上6x6块，A = H^T H的左上6x6块，由Woodbury恒等式
+    K_1.block<18,6> = P'.block<18,6> * S^-1 * (S^-1 + A)^-1
+S^-1 + A 就是位姿的6维信息矩阵。一帧的迭代中P不变，S的Cholesky分解只在set_prior里做一次，
+之后每次迭代只需要一个6x6的LDLT，不再做两次18x18的求逆。
+*/
+struct InfoFormSolver
+{
+    MD(DIM_STATE, 6) PS_inv;  //; P'.block<18,6> * S^-1
+    MD(6, 6) S_inv;           //; 先验的位姿信息矩阵
+    MD(DIM_STATE, DIM_STATE) cov_prior;  //; P'，S不正定时退回原来的闭式解
+    bool factorized;
+
+    InfoFormSolver() : factorized(false) {}
+
+    //; 每帧迭代开始前调用一次
+    void set_prior(const MD(DIM_STATE, DIM_STATE) &cov, double meas_cov)
+    {
+        cov_prior = cov / meas_cov;
+        LLT<MD(6, 6)> llt(cov_prior.block<6, 6>(0, 0));
+        factorized = llt.info() == Success;
+        if (!factorized)
+            return;
+        S_inv = llt.solve(MD(6, 6)::Identity());
+        PS_inv = llt.solve(cov_prior.block<6, DIM_STATE>(0, 0)).transpose();
+    }
+
+    //; HTH: H^T H的左上6x6块，K: K_1的前6列
+    void solve(const MD(6, 6) &HTH, MD(DIM_STATE, 6) &K) const
+    {
+        if (!factorized)
+        {
+            MD(DIM_STATE, DIM_STATE) H_T_H = MD(DIM_STATE, DIM_STATE)::Zero();
+            H_T_H.block<6, 6>(0, 0) = HTH;
+            K = (H_T_H + cov_prior.inverse()).inverse().block<DIM_STATE, 6>(0, 0);
+            return;
+        }
+        LDLT<MD(6, 6)> ldlt(S_inv + HTH);
+        K = ldlt.solve(PS_inv.transpose()).transpose();
+#ifdef INFO_SOLVE_CHECK
+        MD(DIM_STATE, DIM_STATE) H_T_H = MD(DIM_STATE, DIM_STATE)::Zero();
+        H_T_H.block<6, 6>(0, 0) = HTH;
+        MD(DIM_STATE, 6) K_dense = (H_T_H + cov_prior.inverse()).inverse().block<DIM_STATE, 6>(0, 0);
+        double err = (K - K_dense).norm() / K_dense.norm();
+        if (err > 1e-8)
+            printf("[ info solve ]: LDLT gain differs from closed form, relative error %e\n", err);
+#endif
+    }
+};
+
+/* comment
+一个IMU采样的协方差传播 cov = F_x * cov * F_x^T + cov_w，cov_*是ImuProcess里的噪声参数
+F_x是单位阵加几个3x3块: (0,0)=Exp(w,-dt) (0,9)=-I*dt (3,6)=I*dt (6,0)=-R*[a]x*dt (6,12)=-R*dt (6,15)=I*dt
+所以 F_x * cov 只改第0/3/6行块，再乘 F_x^T 只改第0/3/6列块，不用做两次18x18的稠密乘法；
+原地更新时先算要用到别的块原值的那一块(3用6，6用0)
+*/
+inline void propagate_cov(MD(DIM_STATE, DIM_STATE) &cov, const M3D &R_imu, const V3D &acc_avr, const V3D &angvel_avr, double dt,
+                          const V3D &cov_gyr, const V3D &cov_acc, const V3D &cov_bias_gyr, const V3D &cov_bias_acc)
+{
+    M3D acc_avr_skew;
+    acc_avr_skew << SKEW_SYM_MATRX(acc_avr);
+    const M3D F_rot = Exp(angvel_avr, -dt);
+    const M3D F_vel_rot = -R_imu * acc_avr_skew * dt;
+    const M3D F_vel_ba = -R_imu * dt;
+#ifdef COV_PROPAGATION_CHECK
+    MD(DIM_STATE, DIM_STATE) F_x, cov_w, cov_dense;
+    F_x.setIdentity();
+    cov_w.setZero();
+    F_x.block<3, 3>(0, 0) = F_rot;
+    F_x.block<3, 3>(0, 9) = -Eye3d * dt;
+    F_x.block<3, 3>(3, 6) = Eye3d * dt;
+    F_x.block<3, 3>(6, 0) = F_vel_rot;
+    F_x.block<3, 3>(6, 12) = F_vel_ba;
+    F_x.block<3, 3>(6, 15) = Eye3d * dt;
+    cov_w.block<3, 3>(0, 0).diagonal() = cov_gyr * dt * dt;
+    cov_w.block<3, 3>(6, 6) = R_imu * cov_acc.asDiagonal() * R_imu.transpose() * dt * dt;
+    cov_w.block<3, 3>(9, 9).diagonal() = cov_bias_gyr * dt * dt;
+    cov_w.block<3, 3>(12, 12).diagonal() = cov_bias_acc * dt * dt;
+    cov_dense = F_x * cov * F_x.transpose() + cov_w;
+#endif
+
+    /* F_x * cov */
+    cov.block<3, DIM_STATE>(3, 0) += dt * cov.block<3, DIM_STATE>(6, 0);
+    cov.block<3, DIM_STATE>(6, 0) += F_vel_rot * cov.block<3, DIM_STATE>(0, 0) + F_vel_ba * cov.block<3, DIM_STATE>(12, 0) +
+                                     dt * cov.block<3, DIM_STATE>(15, 0);
+    cov.block<3, DIM_STATE>(0, 0) = F_rot * cov.block<3, DIM_STATE>(0, 0) - dt * cov.block<3, DIM_STATE>(9, 0);
+
+    /* (F_x * cov) * F_x^T */
+    cov.block<DIM_STATE, 3>(0, 3) += dt * cov.block<DIM_STATE, 3>(0, 6);
+    cov.block<DIM_STATE, 3>(0, 6) += cov.block<DIM_STATE, 3>(0, 0) * F_vel_rot.transpose() + cov.block<DIM_STATE, 3>(0, 12) * F_vel_ba.transpose() +
+                                     dt * cov.block<DIM_STATE, 3>(0, 15);
+    cov.block<DIM_STATE, 3>(0, 0) = cov.block<DIM_STATE, 3>(0, 0) * F_rot.transpose() - dt * cov.block<DIM_STATE, 3>(0, 9);
+
+    /* + cov_w */
+    cov.block<3, 3>(0, 0).diagonal() += cov_gyr * dt * dt;
+    cov.block<3, 3>(6, 6) += R_imu * cov_acc.asDiagonal() * R_imu.transpose() * dt * dt;
+    cov.block<3, 3>(9, 9).diagonal() += cov_bias_gyr * dt * dt;   // bias gyro covariance
+    cov.block<3, 3>(12, 12).diagonal() += cov_bias_acc * dt * dt; // bias acc covariance
+
+#ifdef COV_PROPAGATION_CHECK
+    double err = (cov - cov_dense).cwiseAbs().maxCoeff() / max(cov_dense.cwiseAbs().maxCoeff(), 1e-12);
+    if (err > 1e-10)
+        printf("[ IMU Process ]: block-sparse covariance differs from dense, rel err %e\n", err);
+#endif
+}
+
 template <typename T>
 T rad2deg(T radians)
 {
@@ -476,9 +586,32 @@ convert to: A/D*x + B/D*y + C/D*z = -1
 solve: A0*x0 = b0
 where A0_i = [x_i, y_i, z_i], x0 = [A/D, B/D, C/D]^T, b0 = [-1, ..., -1]^T
 normvec:  normalized x0
+
+最小二乘解就是正规方程 A0^T*A0*x0 = A0^T*b0 的解，A0^T*A0只有3x3，用伴随矩阵显式求逆，
+比colPivHouseholderQr快很多。累加用double，5个点离原点很远时条件数也够用；
+行列式太小(点几乎共线或者平面过原点)时退回QR。
 */
+#define PLANE_FIT_DET_EPS (1e-12)
+
+//; 3x3正规方程的闭式解，返回false表示病态，需要退回QR
+inline bool solve_plane_normal_equation(double a00, double a01, double a02, double a11, double a12, double a22,
+                                        double b0, double b1, double b2, double &nx, double &ny, double &nz)
+{
+    double c00 = a11 * a22 - a12 * a12, c01 = a02 * a12 - a01 * a22, c02 = a01 * a12 - a02 * a11;
+    double c11 = a00 * a22 - a02 * a02, c12 = a01 * a02 - a00 * a12, c22 = a00 * a11 - a01 * a01;
+    double det = a00 * c00 + a01 * c01 + a02 * c02;
+    double scale = a00 + a11 + a22;
+    if (!(fabs(det) > PLANE_FIT_DET_EPS * scale * scale * scale))
+        return false;
+    double inv_det = 1.0 / det;
+    nx = (c00 * b0 + c01 * b1 + c02 * b2) * inv_det;
+    ny = (c01 * b0 + c11 * b1 + c12 * b2) * inv_det;
+    nz = (c02 * b0 + c12 * b1 + c22 * b2) * inv_det;
+    return true;
+}
+
 template <typename T>
-bool esti_normvector(Matrix<T, 3, 1> &normvec, const PointVector &point, const T &threshold, const int &point_num)
+bool esti_normvector_qr(Matrix<T, 3, 1> &normvec, const PointVector &point, const T &threshold, const int &point_num)
 {
     MatrixXf A(point_num, 3);
     MatrixXf b(point_num, 1);
@@ -506,16 +639,41 @@ bool esti_normvector(Matrix<T, 3, 1> &normvec, const PointVector &point, const T
 }
 
 template <typename T>
-bool esti_plane(Matrix<T, 4, 1> &pca_result, const PointVector &point, const T &threshold)
+bool esti_normvector(Matrix<T, 3, 1> &normvec, const PointVector &point, const T &threshold, const int &point_num)
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0, b0 = 0, b1 = 0, b2 = 0, nx, ny, nz;
+    for (int j = 0; j < point_num; j++)
+    {
+        double x = point[j].x, y = point[j].y, z = point[j].z;
+        a00 += x * x; a01 += x * y; a02 += x * z;
+        a11 += y * y; a12 += y * z; a22 += z * z;
+        b0 -= x; b1 -= y; b2 -= z;
+    }
+    if (!solve_plane_normal_equation(a00, a01, a02, a11, a12, a22, b0, b1, b2, nx, ny, nz))
+        return esti_normvector_qr(normvec, point, threshold, point_num);
+    normvec << T(nx), T(ny), T(nz);
+
+    for (int j = 0; j < point_num; j++)
+    {
+        if (fabs(normvec(0) * point[j].x + normvec(1) * point[j].y + normvec(2) * point[j].z + 1.0f) > threshold)
+        {
+            return false;
+        }
+    }
+
+    normvec.normalize();
+    return true;
+}
+
+//; 原来的QR版本，病态时使用，也用来和闭式解对比
+template <typename T>
+bool esti_plane_qr(Matrix<T, 4, 1> &pca_result, const PointVector &point, const T &threshold)
 {
-    // 定义矩阵 A 和向量 b，用于求解平面方程
-    //平面方程normvec*X+b=0,normvec法向量，X为点坐标，d为截距
     Matrix<T, NUM_MATCH_POINTS, 3> A;
     Matrix<T, NUM_MATCH_POINTS, 1> b;
-    b.setOnes(); // 将 b 初始化为全 1
-    b *= -1.0f; // 将 b 的每个元素乘以 -1
+    b.setOnes();
+    b *= -1.0f;
 
-    // 填充矩阵 A，每行对应一个点的坐标
     for (int j = 0; j < NUM_MATCH_POINTS; j++)
     {
         A(j, 0) = point[j].x;
@@ -547,4 +705,164 @@ bool esti_plane(Matrix<T, 4, 1> &pca_result, const PointVector &point, const T &
     return true;
 }
 
+template <typename T>
+bool esti_plane(Matrix<T, 4, 1> &pca_result, const PointVector &point, const T &threshold)
+{
+    //平面方程normvec*X+b=0,normvec法向量，X为点坐标，d为截距
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0, b0 = 0, b1 = 0, b2 = 0, nx, ny, nz;
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+    {
+        double x = point[j].x, y = point[j].y, z = point[j].z;
+        a00 += x * x; a01 += x * y; a02 += x * z;
+        a11 += y * y; a12 += y * z; a22 += z * z;
+        b0 -= x; b1 -= y; b2 -= z;
+    }
+    if (!solve_plane_normal_equation(a00, a01, a02, a11, a12, a22, b0, b1, b2, nx, ny, nz))
+        return esti_plane_qr(pca_result, point, threshold);
+
+    double inv_n = 1.0 / sqrt(nx * nx + ny * ny + nz * nz);
+    pca_result(0) = T(nx * inv_n);
+    pca_result(1) = T(ny * inv_n);
+    pca_result(2) = T(nz * inv_n);
+    pca_result(3) = T(inv_n);
+
+    // 检查每个点到平面的距离是否小于阈值
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+    {
+        if (fabs(pca_result(0) * point[j].x + pca_result(1) * point[j].y + pca_result(2) * point[j].z + pca_result(3)) > threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* comment
+批量平面拟合: PLANE_FIT_LANES个查询点的近邻按SoA排列，每一步都是对所有通道做同样的运算，
+没有分支，编译器可以直接向量化。阈值判断和esti_plane完全一样，病态的通道单独退回QR。
+*/
+#define PLANE_FIT_LANES (8)
+
+struct PlaneFitBatch
+{
+    float x[NUM_MATCH_POINTS][PLANE_FIT_LANES]; //; [第几个近邻][第几个通道]
+    float y[NUM_MATCH_POINTS][PLANE_FIT_LANES];
+    float z[NUM_MATCH_POINTS][PLANE_FIT_LANES];
+    float pabcd[4][PLANE_FIT_LANES];
+    bool valid[PLANE_FIT_LANES];
+    int lanes; //; 实际使用的通道数
+
+    void set_lane(int l, const PointVector &points)
+    {
+        for (int j = 0; j < NUM_MATCH_POINTS; j++)
+        {
+            x[j][l] = points[j].x;
+            y[j][l] = points[j].y;
+            z[j][l] = points[j].z;
+        }
+    }
+
+    //; 没用到的通道复制第0个通道，避免对未初始化的数据做运算
+    void pad()
+    {
+        for (int l = lanes; l < PLANE_FIT_LANES; l++)
+        {
+            for (int j = 0; j < NUM_MATCH_POINTS; j++)
+            {
+                x[j][l] = x[j][0];
+                y[j][l] = y[j][0];
+                z[j][l] = z[j][0];
+            }
+        }
+    }
+};
+
+inline void esti_plane_batch(PlaneFitBatch &batch, const float threshold)
+{
+    double a00[PLANE_FIT_LANES], a01[PLANE_FIT_LANES], a02[PLANE_FIT_LANES], a11[PLANE_FIT_LANES], a12[PLANE_FIT_LANES], a22[PLANE_FIT_LANES];
+    double b0[PLANE_FIT_LANES], b1[PLANE_FIT_LANES], b2[PLANE_FIT_LANES], det[PLANE_FIT_LANES], scale[PLANE_FIT_LANES];
+    double nx[PLANE_FIT_LANES], ny[PLANE_FIT_LANES], nz[PLANE_FIT_LANES];
+    for (int l = 0; l < PLANE_FIT_LANES; l++)
+    {
+        a00[l] = a01[l] = a02[l] = a11[l] = a12[l] = a22[l] = b0[l] = b1[l] = b2[l] = 0;
+    }
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+    {
+        for (int l = 0; l < PLANE_FIT_LANES; l++)
+        {
+            double x = batch.x[j][l], y = batch.y[j][l], z = batch.z[j][l];
+            a00[l] += x * x; a01[l] += x * y; a02[l] += x * z;
+            a11[l] += y * y; a12[l] += y * z; a22[l] += z * z;
+            b0[l] -= x; b1[l] -= y; b2[l] -= z;
+        }
+    }
+    for (int l = 0; l < PLANE_FIT_LANES; l++)
+    {
+        double c00 = a11[l] * a22[l] - a12[l] * a12[l], c01 = a02[l] * a12[l] - a01[l] * a22[l], c02 = a01[l] * a12[l] - a02[l] * a11[l];
+        double c11 = a00[l] * a22[l] - a02[l] * a02[l], c12 = a01[l] * a02[l] - a00[l] * a12[l], c22 = a00[l] * a11[l] - a01[l] * a01[l];
+        det[l] = a00[l] * c00 + a01[l] * c01 + a02[l] * c02;
+        scale[l] = a00[l] + a11[l] + a22[l];
+        double inv_det = 1.0 / det[l];
+        nx[l] = (c00 * b0[l] + c01 * b1[l] + c02 * b2[l]) * inv_det;
+        ny[l] = (c01 * b0[l] + c11 * b1[l] + c12 * b2[l]) * inv_det;
+        nz[l] = (c02 * b0[l] + c12 * b1[l] + c22 * b2[l]) * inv_det;
+        double inv_n = 1.0 / sqrt(nx[l] * nx[l] + ny[l] * ny[l] + nz[l] * nz[l]);
+        batch.pabcd[0][l] = float(nx[l] * inv_n);
+        batch.pabcd[1][l] = float(ny[l] * inv_n);
+        batch.pabcd[2][l] = float(nz[l] * inv_n);
+        batch.pabcd[3][l] = float(inv_n);
+    }
+    float max_dist[PLANE_FIT_LANES];
+    for (int l = 0; l < PLANE_FIT_LANES; l++)
+        max_dist[l] = 0;
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+    {
+        for (int l = 0; l < PLANE_FIT_LANES; l++)
+        {
+            float d = fabsf(batch.pabcd[0][l] * batch.x[j][l] + batch.pabcd[1][l] * batch.y[j][l] +
+                            batch.pabcd[2][l] * batch.z[j][l] + batch.pabcd[3][l]);
+            max_dist[l] = d > max_dist[l] ? d : max_dist[l];
+        }
+    }
+    for (int l = 0; l < batch.lanes; l++)
+    {
+        batch.valid[l] = max_dist[l] <= threshold;
+        if (!(fabs(det[l]) > PLANE_FIT_DET_EPS * scale[l] * scale[l] * scale[l]))
+        {
+            //; 病态的通道退回QR
+            PointVector points(NUM_MATCH_POINTS);
+            for (int j = 0; j < NUM_MATCH_POINTS; j++)
+            {
+                points[j].x = batch.x[j][l];
+                points[j].y = batch.y[j][l];
+                points[j].z = batch.z[j][l];
+            }
+            VF(4) pabcd;
+            batch.valid[l] = esti_plane_qr(pabcd, points, threshold);
+            for (int k = 0; k < 4; k++)
+                batch.pabcd[k][l] = pabcd(k);
+        }
+#ifdef PLANE_FIT_CHECK
+        else
+        {
+            PointVector points(NUM_MATCH_POINTS);
+            for (int j = 0; j < NUM_MATCH_POINTS; j++)
+            {
+                points[j].x = batch.x[j][l];
+                points[j].y = batch.y[j][l];
+                points[j].z = batch.z[j][l];
+            }
+            VF(4) pabcd;
+            bool valid_qr = esti_plane_qr(pabcd, points, threshold);
+            float diff = 0;
+            for (int k = 0; k < 3; k++)
+                diff = max(diff, fabsf(pabcd(k) - batch.pabcd[k][l]));
+            diff = max(diff, fabsf(pabcd(3) - batch.pabcd[3][l]) / max(1.0f, fabsf(pabcd(3))));
+            if (valid_qr != batch.valid[l] || (valid_qr && diff > 1e-3f))
+                printf("[ plane fit ]: closed form differs from QR, valid %d/%d, max diff %f\n", int(batch.valid[l]), int(valid_qr), diff);
+        }
+#endif
+    }
+}
+
 #endif
\ No newline at end of file
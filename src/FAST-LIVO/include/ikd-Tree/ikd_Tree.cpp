@@ -1,4 +1,9 @@
 #include "ikd_Tree.h"
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 /*
 Description: ikd-Tree: an incremental k-d tree for robotic applications 
@@ -171,6 +176,14 @@ void KD_TREE::stop_thread(){
     termination_flag = true;
     pthread_mutex_unlock(&termination_flag_mutex_lock);
     if (rebuild_thread) pthread_join(rebuild_thread, NULL);
+    // Wait for the rebuild job on the scheduler
+    pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+    while (rebuild_submitted){
+        pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
+        usleep(100);
+        pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+    }
+    pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
     pthread_mutex_destroy(&termination_flag_mutex_lock);
     pthread_mutex_destroy(&rebuild_logger_mutex_lock);
     pthread_mutex_destroy(&rebuild_ptr_mutex_lock);
@@ -182,122 +195,163 @@ void KD_TREE::stop_thread(){
 void * KD_TREE::multi_thread_ptr(void * arg){
     KD_TREE * handle = (KD_TREE*) arg;
     handle->multi_thread_rebuild();
+    return nullptr;
 }    
 
 void KD_TREE::multi_thread_rebuild(){
     bool terminated = false;
-    KD_TREE_NODE * father_ptr, ** new_node_ptr;
     pthread_mutex_lock(&termination_flag_mutex_lock);
     terminated = termination_flag;
     pthread_mutex_unlock(&termination_flag_mutex_lock);
     while (!terminated){
-        pthread_mutex_lock(&rebuild_ptr_mutex_lock);
-        pthread_mutex_lock(&working_flag_mutex);
-        if (Rebuild_Ptr != nullptr ){                    
-            /* Traverse and copy */
-            if (!Rebuild_Logger.empty()){
-                printf("\n\n\n\n\n\n\n\n\n\n\n ERROR!!! \n\n\n\n\n\n\n\n\n");
-            }
-            rebuild_flag = true;
-            if (*Rebuild_Ptr == Root_Node) {
-                Treesize_tmp = Root_Node->TreeSize;
-                Validnum_tmp = Root_Node->TreeSize - Root_Node->invalid_point_num;
-                alpha_bal_tmp = Root_Node->alpha_bal;
-                alpha_del_tmp = Root_Node->alpha_del;
-            }
-            KD_TREE_NODE * old_root_node = (*Rebuild_Ptr);                            
-            father_ptr = (*Rebuild_Ptr)->father_ptr;  
-            PointVector ().swap(Rebuild_PCL_Storage);
-            // Lock Search 
-            pthread_mutex_lock(&search_flag_mutex);
-            while (search_mutex_counter != 0){
-                pthread_mutex_unlock(&search_flag_mutex);
-                usleep(1);             
-                pthread_mutex_lock(&search_flag_mutex);
-            }
-            search_mutex_counter = -1;
+        rebuild_once();
+        pthread_mutex_lock(&termination_flag_mutex_lock);
+        terminated = termination_flag;
+        pthread_mutex_unlock(&termination_flag_mutex_lock);
+        usleep(100); 
+    }
+    printf("Rebuild thread terminated normally\n");    
+}
+
+void KD_TREE::rebuild_once(){
+    KD_TREE_NODE * father_ptr;
+    pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+    pthread_mutex_lock(&working_flag_mutex);
+    if (Rebuild_Ptr != nullptr ){                    
+        /* Traverse and copy */
+        if (!Rebuild_Logger.empty()){
+            printf("\n\n\n\n\n\n\n\n\n\n\n ERROR!!! \n\n\n\n\n\n\n\n\n");
+        }
+        rebuild_flag = true;
+        if (*Rebuild_Ptr == Root_Node) {
+            Treesize_tmp = Root_Node->TreeSize;
+            Validnum_tmp = Root_Node->TreeSize - Root_Node->invalid_point_num;
+            alpha_bal_tmp = Root_Node->alpha_bal;
+            alpha_del_tmp = Root_Node->alpha_del;
+        }
+        KD_TREE_NODE * old_root_node = (*Rebuild_Ptr);                            
+        father_ptr = (*Rebuild_Ptr)->father_ptr;  
+        PointVector ().swap(Rebuild_PCL_Storage);
+        // Lock Search 
+        pthread_mutex_lock(&search_flag_mutex);
+        while (search_mutex_counter != 0){
             pthread_mutex_unlock(&search_flag_mutex);
-            // Lock deleted points cache
-            pthread_mutex_lock(&points_deleted_rebuild_mutex_lock);    
-            flatten(*Rebuild_Ptr, Rebuild_PCL_Storage, MULTI_THREAD_REC);
-            // Unlock deleted points cache
-            pthread_mutex_unlock(&points_deleted_rebuild_mutex_lock);
-            // Unlock Search
+            usleep(1);             
             pthread_mutex_lock(&search_flag_mutex);
-            search_mutex_counter = 0;
-            pthread_mutex_unlock(&search_flag_mutex);              
-            pthread_mutex_unlock(&working_flag_mutex);   
-            /* Rebuild and update missed operations*/
-            Operation_Logger_Type Operation;
-            KD_TREE_NODE * new_root_node = nullptr;  
-            if (int(Rebuild_PCL_Storage.size()) > 0){
-                BuildTree(&new_root_node, 0, Rebuild_PCL_Storage.size()-1, Rebuild_PCL_Storage);
-                // Rebuild has been done. Updates the blocked operations into the new tree
+        }
+        search_mutex_counter = -1;
+        pthread_mutex_unlock(&search_flag_mutex);
+        // Lock deleted points cache
+        pthread_mutex_lock(&points_deleted_rebuild_mutex_lock);    
+        flatten(*Rebuild_Ptr, Rebuild_PCL_Storage, MULTI_THREAD_REC);
+        // Unlock deleted points cache
+        pthread_mutex_unlock(&points_deleted_rebuild_mutex_lock);
+        // Unlock Search
+        pthread_mutex_lock(&search_flag_mutex);
+        search_mutex_counter = 0;
+        pthread_mutex_unlock(&search_flag_mutex);              
+        pthread_mutex_unlock(&working_flag_mutex);   
+        /* Rebuild and update missed operations*/
+        Operation_Logger_Type Operation;
+        KD_TREE_NODE * new_root_node = nullptr;  
+        if (int(Rebuild_PCL_Storage.size()) > 0){
+            BuildTree(&new_root_node, 0, Rebuild_PCL_Storage.size()-1, Rebuild_PCL_Storage);
+            // Rebuild has been done. Updates the blocked operations into the new tree
+            pthread_mutex_lock(&working_flag_mutex);
+            pthread_mutex_lock(&rebuild_logger_mutex_lock);
+            int tmp_counter = 0;
+            while (!Rebuild_Logger.empty()){
+                Operation = Rebuild_Logger.front();
+                max_queue_size = max(max_queue_size, Rebuild_Logger.size());
+                Rebuild_Logger.pop();
+                pthread_mutex_unlock(&rebuild_logger_mutex_lock);                  
+                pthread_mutex_unlock(&working_flag_mutex);
+                run_operation(&new_root_node, Operation);
+                tmp_counter ++;
+                if (tmp_counter % 10 == 0) usleep(1);
                 pthread_mutex_lock(&working_flag_mutex);
-                pthread_mutex_lock(&rebuild_logger_mutex_lock);
-                int tmp_counter = 0;
-                while (!Rebuild_Logger.empty()){
-                    Operation = Rebuild_Logger.front();
-                    max_queue_size = max(max_queue_size, Rebuild_Logger.size());
-                    Rebuild_Logger.pop();
-                    pthread_mutex_unlock(&rebuild_logger_mutex_lock);                  
-                    pthread_mutex_unlock(&working_flag_mutex);
-                    run_operation(&new_root_node, Operation);
-                    tmp_counter ++;
-                    if (tmp_counter % 10 == 0) usleep(1);
-                    pthread_mutex_lock(&working_flag_mutex);
-                    pthread_mutex_lock(&rebuild_logger_mutex_lock);               
-                }   
-               pthread_mutex_unlock(&rebuild_logger_mutex_lock);
-            }  
-            /* Replace to original tree*/          
-            // pthread_mutex_lock(&working_flag_mutex);
-            pthread_mutex_lock(&search_flag_mutex);
-            while (search_mutex_counter != 0){
-                pthread_mutex_unlock(&search_flag_mutex);
-                usleep(1);             
-                pthread_mutex_lock(&search_flag_mutex);
-            }
-            search_mutex_counter = -1;
+                pthread_mutex_lock(&rebuild_logger_mutex_lock);               
+            }   
+           pthread_mutex_unlock(&rebuild_logger_mutex_lock);
+        }  
+        /* Replace to original tree*/          
+        // pthread_mutex_lock(&working_flag_mutex);
+        pthread_mutex_lock(&search_flag_mutex);
+        while (search_mutex_counter != 0){
             pthread_mutex_unlock(&search_flag_mutex);
-            if (father_ptr->left_son_ptr == *Rebuild_Ptr) {
-                father_ptr->left_son_ptr = new_root_node;
-            } else if (father_ptr->right_son_ptr == *Rebuild_Ptr){             
-                father_ptr->right_son_ptr = new_root_node;
-            } else {
-                throw "Error: Father ptr incompatible with current node\n";
-            }
-            if (new_root_node != nullptr) new_root_node->father_ptr = father_ptr;
-            (*Rebuild_Ptr) = new_root_node;
-            int valid_old = old_root_node->TreeSize-old_root_node->invalid_point_num;
-            int valid_new = new_root_node->TreeSize-new_root_node->invalid_point_num;
-            if (father_ptr == STATIC_ROOT_NODE) Root_Node = STATIC_ROOT_NODE->left_son_ptr;
-            KD_TREE_NODE * update_root = *Rebuild_Ptr;
-            while (update_root != nullptr && update_root != Root_Node){
-                update_root = update_root->father_ptr;
-                if (update_root->working_flag) break;
-                if (update_root == update_root->father_ptr->left_son_ptr && update_root->father_ptr->need_push_down_to_left) break;
-                if (update_root == update_root->father_ptr->right_son_ptr && update_root->father_ptr->need_push_down_to_right) break;
-                Update(update_root);
-            }
+            usleep(1);             
             pthread_mutex_lock(&search_flag_mutex);
-            search_mutex_counter = 0;
-            pthread_mutex_unlock(&search_flag_mutex);
-            Rebuild_Ptr = nullptr;
-            pthread_mutex_unlock(&working_flag_mutex);
-            rebuild_flag = false;                     
-            /* Delete discarded tree nodes */
-            delete_tree_nodes(&old_root_node);
+        }
+        search_mutex_counter = -1;
+        pthread_mutex_unlock(&search_flag_mutex);
+        if (father_ptr->left_son_ptr == *Rebuild_Ptr) {
+            father_ptr->left_son_ptr = new_root_node;
+        } else if (father_ptr->right_son_ptr == *Rebuild_Ptr){             
+            father_ptr->right_son_ptr = new_root_node;
         } else {
-            pthread_mutex_unlock(&working_flag_mutex);             
+            throw "Error: Father ptr incompatible with current node\n";
         }
-        pthread_mutex_unlock(&rebuild_ptr_mutex_lock);         
-        pthread_mutex_lock(&termination_flag_mutex_lock);
-        terminated = termination_flag;
-        pthread_mutex_unlock(&termination_flag_mutex_lock);
-        usleep(100); 
+        if (new_root_node != nullptr) new_root_node->father_ptr = father_ptr;
+        (*Rebuild_Ptr) = new_root_node;
+        int valid_old = old_root_node->TreeSize-old_root_node->invalid_point_num;
+        int valid_new = new_root_node->TreeSize-new_root_node->invalid_point_num;
+        if (father_ptr == STATIC_ROOT_NODE) Root_Node = STATIC_ROOT_NODE->left_son_ptr;
+        KD_TREE_NODE * update_root = *Rebuild_Ptr;
+        while (update_root != nullptr && update_root != Root_Node){
+            update_root = update_root->father_ptr;
+            if (update_root->working_flag) break;
+            if (update_root == update_root->father_ptr->left_son_ptr && update_root->father_ptr->need_push_down_to_left) break;
+            if (update_root == update_root->father_ptr->right_son_ptr && update_root->father_ptr->need_push_down_to_right) break;
+            Update(update_root);
+        }
+        pthread_mutex_lock(&search_flag_mutex);
+        search_mutex_counter = 0;
+        pthread_mutex_unlock(&search_flag_mutex);
+        Rebuild_Ptr = nullptr;
+        // Clear the flag under working_flag_mutex, otherwise an operation in between is logged and replayed on the next rebuild
+        rebuild_flag = false;                     
+        pthread_mutex_unlock(&working_flag_mutex);
+        /* Delete discarded tree nodes */
+        delete_tree_nodes(&old_root_node);
+    } else {
+        pthread_mutex_unlock(&working_flag_mutex);             
+    }
+    pthread_mutex_unlock(&rebuild_ptr_mutex_lock);         
+}
+
+void KD_TREE::Set_Scheduler(TaskScheduler * scheduler){
+    // Only switch when the pool has worker threads, a job submitted to it must not run on the thread that set Rebuild_Ptr
+    if (scheduler == nullptr || scheduler->thread_num() <= 1 || rebuild_scheduler != nullptr) return;
+    pthread_mutex_lock(&termination_flag_mutex_lock);
+    termination_flag = true;
+    pthread_mutex_unlock(&termination_flag_mutex_lock);
+    pthread_join(rebuild_thread, NULL);
+    rebuild_thread = 0;
+    pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+    rebuild_scheduler = scheduler;
+    // The polling thread may have stopped before picking up the last request
+    if (Rebuild_Ptr != nullptr) submit_rebuild();
+    pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
+}
+
+// Called with rebuild_ptr_mutex_lock held, right after Rebuild_Ptr is set
+void KD_TREE::submit_rebuild(){
+    if (rebuild_scheduler == nullptr || rebuild_submitted) return;
+    if (rebuild_scheduler->submit([this]{ rebuild_task(); }, TASK_MAP)) rebuild_submitted = true;
+}
+
+void KD_TREE::rebuild_task(){
+    // Rebuild_Ptr can only be set again after the current rebuild clears it, so keep going until nothing is left
+    while (true){
+        rebuild_once();
+        pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+        if (Rebuild_Ptr == nullptr){
+            rebuild_submitted = false;
+            pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
+            return;
+        }
+        pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
     }
-    printf("Rebuild thread terminated normally\n");    
 }
 
 void KD_TREE::run_operation(KD_TREE_NODE ** root, Operation_Logger_Type operation){
@@ -379,6 +433,28 @@ void KD_TREE::Nearest_Search(PointType point, int k_nearest, PointVector& Neares
     return;
 }
 
+void KD_TREE::Box_Search(const BoxPointType &Box_of_Point, PointVector &Storage){
+    Storage.clear();
+    if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != Root_Node){
+        Search_by_range(Root_Node, Box_of_Point, Storage);
+    } else {
+        pthread_mutex_lock(&search_flag_mutex);
+        while (search_mutex_counter == -1)
+        {
+            pthread_mutex_unlock(&search_flag_mutex);
+            usleep(1);
+            pthread_mutex_lock(&search_flag_mutex);
+        }
+        search_mutex_counter += 1;
+        pthread_mutex_unlock(&search_flag_mutex);
+        Search_by_range(Root_Node, Box_of_Point, Storage);
+        pthread_mutex_lock(&search_flag_mutex);
+        search_mutex_counter -= 1;
+        pthread_mutex_unlock(&search_flag_mutex);
+    }
+    return;
+}
+
 int KD_TREE::Add_Points(PointVector & PointToAdd, bool downsample_on){
     int NewPointSize = PointToAdd.size();
     int tree_size = size();
@@ -399,7 +475,7 @@ int KD_TREE::Add_Points(PointVector & PointToAdd, bool downsample_on){
             mid_point.y = Box_of_Point.vertex_min[1] + (Box_of_Point.vertex_max[1]-Box_of_Point.vertex_min[1])/2.0;
             mid_point.z = Box_of_Point.vertex_min[2] + (Box_of_Point.vertex_max[2]-Box_of_Point.vertex_min[2])/2.0;
             PointVector ().swap(Downsample_Storage);
-            Search_by_range(Root_Node, Box_of_Point, Downsample_Storage);
+            Box_Search(Box_of_Point, Downsample_Storage);
             min_dist = calc_dist(PointToAdd[i],mid_point);
             downsample_result = PointToAdd[i];                
             for (int index = 0; index < Downsample_Storage.size(); index++){
@@ -456,6 +532,88 @@ int KD_TREE::Add_Points(PointVector & PointToAdd, bool downsample_on){
     return tmp_counter;
 }
 
+// Same result as Add_Points(PointToAdd, true), but the incoming points are grouped by downsample voxel first:
+// one box search per occupied voxel, then all box deletes, then all inserts.
+int KD_TREE::Add_Points_Batch(PointVector & PointToAdd, PointVector * Points_Added, PointVector * Points_Removed){
+    if (!DOWNSAMPLE_SWITCH){
+        if (Points_Added != nullptr) Points_Added->insert(Points_Added->end(), PointToAdd.begin(), PointToAdd.end());
+        return Add_Points(PointToAdd, false);
+    }
+    int NewPointSize = PointToAdd.size();
+    vector<pair<Eigen::Vector3i, int>> voxel_index(NewPointSize);
+    for (int i = 0; i < NewPointSize; i++){
+        voxel_index[i].first = Eigen::Vector3i(floor(PointToAdd[i].x/downsample_size), floor(PointToAdd[i].y/downsample_size), floor(PointToAdd[i].z/downsample_size));
+        voxel_index[i].second = i;
+    }
+    sort(voxel_index.begin(), voxel_index.end(), [](const pair<Eigen::Vector3i, int> &a, const pair<Eigen::Vector3i, int> &b){
+        if (a.first.x() != b.first.x()) return a.first.x() < b.first.x();
+        if (a.first.y() != b.first.y()) return a.first.y() < b.first.y();
+        if (a.first.z() != b.first.z()) return a.first.z() < b.first.z();
+        return a.second < b.second;
+    });
+    vector<BoxPointType> Box_To_Delete;
+    PointVector Point_To_Add;
+    BoxPointType Box_of_Point;
+    PointType downsample_result, mid_point;
+    float min_dist, tmp_dist;
+    for (int begin = 0, end = 0; begin < NewPointSize; begin = end){
+        while (end < NewPointSize && voxel_index[end].first == voxel_index[begin].first) end++;
+        for (int j = 0; j < 3; j++){
+            Box_of_Point.vertex_min[j] = voxel_index[begin].first(j)*downsample_size;
+            Box_of_Point.vertex_max[j] = Box_of_Point.vertex_min[j]+downsample_size;
+        }
+        mid_point.x = Box_of_Point.vertex_min[0] + downsample_size/2.0;
+        mid_point.y = Box_of_Point.vertex_min[1] + downsample_size/2.0;
+        mid_point.z = Box_of_Point.vertex_min[2] + downsample_size/2.0;
+        PointVector ().swap(Downsample_Storage);
+        Box_Search(Box_of_Point, Downsample_Storage);
+        // The voxel keeps the point closest to its center among the map points and all incoming points
+        bool result_is_new = false;
+        min_dist = INFINITY;
+        for (int index = 0; index < Downsample_Storage.size(); index++){
+            tmp_dist = calc_dist(Downsample_Storage[index], mid_point);
+            if (tmp_dist < min_dist){
+                min_dist = tmp_dist;
+                downsample_result = Downsample_Storage[index];
+            }
+        }
+        for (int k = begin; k < end; k++){
+            tmp_dist = calc_dist(PointToAdd[voxel_index[k].second], mid_point);
+            if (tmp_dist <= min_dist){
+                min_dist = tmp_dist;
+                downsample_result = PointToAdd[voxel_index[k].second];
+                result_is_new = true;
+            }
+        }
+        if (Downsample_Storage.size() > 1 || result_is_new){
+            if (Downsample_Storage.size() > 0) Box_To_Delete.push_back(Box_of_Point);
+            Point_To_Add.push_back(downsample_result);
+            // The whole box is deleted and the kept point inserted again, report it the same way
+            if (Points_Removed != nullptr) Points_Removed->insert(Points_Removed->end(), Downsample_Storage.begin(), Downsample_Storage.end());
+        }
+    }
+    for (int i = 0; i < Box_To_Delete.size(); i++){
+        if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != Root_Node){
+            Delete_by_range(&Root_Node, Box_To_Delete[i], true, true);
+        } else {
+            Operation_Logger_Type operation_delete;
+            operation_delete.boxpoint = Box_To_Delete[i];
+            operation_delete.op = DOWNSAMPLE_DELETE;
+            pthread_mutex_lock(&working_flag_mutex);
+            Delete_by_range(&Root_Node, Box_To_Delete[i], false, true);
+            if (rebuild_flag){
+                pthread_mutex_lock(&rebuild_logger_mutex_lock);
+                Rebuild_Logger.push(operation_delete);
+                pthread_mutex_unlock(&rebuild_logger_mutex_lock);
+            }
+            pthread_mutex_unlock(&working_flag_mutex);
+        }
+    }
+    Add_Points(Point_To_Add, false);
+    if (Points_Added != nullptr) Points_Added->insert(Points_Added->end(), Point_To_Add.begin(), Point_To_Add.end());
+    return Point_To_Add.size();
+}
+
 void KD_TREE::Add_Point_Boxes(vector<BoxPointType> & BoxPoints){     
     for (int i=0;i < BoxPoints.size();i++){
         if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != Root_Node){
@@ -534,31 +692,10 @@ void KD_TREE::acquire_removed_points(PointVector & removed_points){
     return;
 }
 
-void KD_TREE::BuildTree(KD_TREE_NODE ** root, int l, int r, PointVector & Storage){
-    if (l>r) return;
-    *root = new KD_TREE_NODE;
-    InitTreeNode(*root);
+int KD_TREE::divide_by_longest_axis(int l, int r, PointVector & Storage){
     int mid = (l+r)>>1;
     int div_axis = 0;
     int i;
-    // Find the best division Axis
-    // float average[3] = {0,0,0};
-    // float covariance[3] = {0,0,0};
-    // for (i=l;i<=r;i++){
-    //     average[0] += Storage[i].x;
-    //     average[1] += Storage[i].y;
-    //     average[2] += Storage[i].z;
-    // }
-    // for (i=0;i<3;i++) average[i] = average[i]/(r-l+1);
-    // for (i=l;i<=r;i++){
-    //     covariance[0] += (Storage[i].x - average[0]) * (Storage[i].x - average[0]);
-    //     covariance[1] += (Storage[i].y - average[1]) * (Storage[i].y - average[1]);  
-    //     covariance[2] += (Storage[i].z - average[2]) * (Storage[i].z - average[2]);              
-    // }
-    // for (i=0;i<3;i++) covariance[i] = covariance[i]/(r-l+1);   
-    // for (i = 1;i<3;i++){
-    //     if (covariance[i] > covariance[div_axis]) div_axis = i;
-    // }
     // Select the longest dimension as division axis
     float min_value[3] = {INFINITY, INFINITY, INFINITY};
     float max_value[3] = {-INFINITY, -INFINITY, -INFINITY};
@@ -573,9 +710,7 @@ void KD_TREE::BuildTree(KD_TREE_NODE ** root, int l, int r, PointVector & Storag
     }
     for (i=0;i<3;i++) dim_range[i] = max_value[i] - min_value[i];
     for (i=1;i<3;i++) if (dim_range[i] > dim_range[div_axis]) div_axis = i;
-    // Divide by the division axis and recursively build.
-
-    (*root)->division_axis = div_axis;
+    // Put the median along the division axis at mid
     switch (div_axis)
     {
     case 0:
@@ -591,6 +726,36 @@ void KD_TREE::BuildTree(KD_TREE_NODE ** root, int l, int r, PointVector & Storag
         nth_element(begin(Storage)+l, begin(Storage)+mid, begin(Storage)+r+1, point_cmp_x);
         break;
     }  
+    return div_axis;
+}
+
+void KD_TREE::BuildTree(KD_TREE_NODE ** root, int l, int r, PointVector & Storage){
+    if (l>r) return;
+    *root = new KD_TREE_NODE;
+    InitTreeNode(*root);
+    int mid = (l+r)>>1;
+    int div_axis = 0;
+    int i;
+    // Find the best division Axis
+    // float average[3] = {0,0,0};
+    // float covariance[3] = {0,0,0};
+    // for (i=l;i<=r;i++){
+    //     average[0] += Storage[i].x;
+    //     average[1] += Storage[i].y;
+    //     average[2] += Storage[i].z;
+    // }
+    // for (i=0;i<3;i++) average[i] = average[i]/(r-l+1);
+    // for (i=l;i<=r;i++){
+    //     covariance[0] += (Storage[i].x - average[0]) * (Storage[i].x - average[0]);
+    //     covariance[1] += (Storage[i].y - average[1]) * (Storage[i].y - average[1]);  
+    //     covariance[2] += (Storage[i].z - average[2]) * (Storage[i].z - average[2]);              
+    // }
+    // for (i=0;i<3;i++) covariance[i] = covariance[i]/(r-l+1);   
+    // for (i = 1;i<3;i++){
+    //     if (covariance[i] > covariance[div_axis]) div_axis = i;
+    // }
+    div_axis = divide_by_longest_axis(l, r, Storage);
+    (*root)->division_axis = div_axis;
     (*root)->point = Storage[mid]; 
     KD_TREE_NODE * left_son = nullptr, * right_son = nullptr;
     BuildTree(&left_son, l, mid-1, Storage);
@@ -607,6 +772,7 @@ void KD_TREE::Rebuild(KD_TREE_NODE ** root){
         if (!pthread_mutex_trylock(&rebuild_ptr_mutex_lock)){     
             if (Rebuild_Ptr == nullptr || ((*root)->TreeSize > (*Rebuild_Ptr)->TreeSize)) {
                 Rebuild_Ptr = root;          
+                submit_rebuild();
             }
             pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
         }
@@ -868,7 +1034,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
     float dist_right_node = calc_box_dist(root->right_son_ptr, point);
     if (q.size()< k_nearest || dist_left_node < q.top().dist && dist_right_node < q.top().dist){
         if (dist_left_node <= dist_right_node) {
-            if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->left_son_ptr){
+            if (!rebuild_owns(root->left_son_ptr)){
                 Search(root->left_son_ptr, k_nearest, point, q, max_dist);                       
             } else {
                 pthread_mutex_lock(&search_flag_mutex);
@@ -886,7 +1052,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
                 pthread_mutex_unlock(&search_flag_mutex);
             }
             if (q.size() < k_nearest || dist_right_node < q.top().dist) {
-                if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->right_son_ptr){
+                if (!rebuild_owns(root->right_son_ptr)){
                     Search(root->right_son_ptr, k_nearest, point, q, max_dist);                       
                 } else {
                     pthread_mutex_lock(&search_flag_mutex);
@@ -905,7 +1071,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
                 }                
             }
         } else {
-            if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->right_son_ptr){
+            if (!rebuild_owns(root->right_son_ptr)){
                 Search(root->right_son_ptr, k_nearest, point, q, max_dist);                       
             } else {
                 pthread_mutex_lock(&search_flag_mutex);
@@ -923,7 +1089,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
                 pthread_mutex_unlock(&search_flag_mutex);
             }
             if (q.size() < k_nearest || dist_left_node < q.top().dist) {            
-                if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->left_son_ptr){
+                if (!rebuild_owns(root->left_son_ptr)){
                     Search(root->left_son_ptr, k_nearest, point, q, max_dist);                       
                 } else {
                     pthread_mutex_lock(&search_flag_mutex);
@@ -944,7 +1110,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
         }
     } else {
         if (dist_left_node < q.top().dist) {        
-            if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->left_son_ptr){
+            if (!rebuild_owns(root->left_son_ptr)){
                 Search(root->left_son_ptr, k_nearest, point, q, max_dist);                       
             } else {
                 pthread_mutex_lock(&search_flag_mutex);
@@ -963,7 +1129,7 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
             }
         }
         if (dist_right_node < q.top().dist) {
-            if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->right_son_ptr){
+            if (!rebuild_owns(root->right_son_ptr)){
                 Search(root->right_son_ptr, k_nearest, point, q, max_dist);                       
             } else {
                 pthread_mutex_lock(&search_flag_mutex);
@@ -985,31 +1151,65 @@ void KD_TREE::Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL
     return;
 }
 
+// Whether son_ptr is the subtree the rebuild thread is working on. The rebuild target is read before the son pointer:
+// if the rebuild thread swaps in between, the search either takes the counter protected path or walks the new subtree,
+// never the old one that is about to be freed.
+bool KD_TREE::rebuild_owns(KD_TREE_NODE * const & son_ptr){
+    KD_TREE_NODE ** rebuild_ptr = Rebuild_Ptr;
+    if (rebuild_ptr == nullptr) return false;
+    KD_TREE_NODE * rebuild_root = *rebuild_ptr;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return son_ptr == rebuild_root;
+}
+
 void KD_TREE::Search_by_range(KD_TREE_NODE *root, BoxPointType boxpoint, PointVector & Storage){
     if (root == nullptr) return;
     Push_Down(root);       
     if (boxpoint.vertex_max[0] <= root->node_range_x[0] || boxpoint.vertex_min[0] > root->node_range_x[1]) return;
     if (boxpoint.vertex_max[1] <= root->node_range_y[0] || boxpoint.vertex_min[1] > root->node_range_y[1]) return;
     if (boxpoint.vertex_max[2] <= root->node_range_z[0] || boxpoint.vertex_min[2] > root->node_range_z[1]) return;
-    if (boxpoint.vertex_min[0] <= root->node_range_x[0] && boxpoint.vertex_max[0] > root->node_range_x[1] && boxpoint.vertex_min[1] <= root->node_range_y[0] && boxpoint.vertex_max[1] > root->node_range_y[1] && boxpoint.vertex_min[2] <= root->node_range_z[0] && boxpoint.vertex_max[2] > root->node_range_z[1]){
+    if (boxpoint.vertex_min[0] <= root->node_range_x[0] && boxpoint.vertex_max[0] > root->node_range_x[1] && boxpoint.vertex_min[1] <= root->node_range_y[0] && boxpoint.vertex_max[1] > root->node_range_y[1] && boxpoint.vertex_min[2] <= root->node_range_z[0] && boxpoint.vertex_max[2] > root->node_range_z[1] && Rebuild_Ptr == nullptr){
+        // flatten walks the whole subtree without checking the rebuild target, only take this shortcut when no rebuild is pending
         flatten(root, Storage, NOT_RECORD);
         return;
     }
     if (boxpoint.vertex_min[0] <= root->point.x && boxpoint.vertex_max[0] > root->point.x && boxpoint.vertex_min[1] <= root->point.y && boxpoint.vertex_max[1] > root->point.y && boxpoint.vertex_min[2] <= root->point.z && boxpoint.vertex_max[2] > root->point.z){
         if (!root->point_deleted) Storage.push_back(root->point);
     }
-    if ((Rebuild_Ptr == nullptr) || root->left_son_ptr != *Rebuild_Ptr){
+    if (!rebuild_owns(root->left_son_ptr)){
         Search_by_range(root->left_son_ptr, boxpoint, Storage);
     } else {
+        // Same protocol as Search: the rebuild thread sets the counter to -1 while it swaps and frees this subtree
         pthread_mutex_lock(&search_flag_mutex);
+        while (search_mutex_counter == -1)
+        {
+            pthread_mutex_unlock(&search_flag_mutex);
+            usleep(1);
+            pthread_mutex_lock(&search_flag_mutex);
+        }
+        search_mutex_counter += 1;
+        pthread_mutex_unlock(&search_flag_mutex);
         Search_by_range(root->left_son_ptr, boxpoint, Storage);
+        pthread_mutex_lock(&search_flag_mutex);
+        search_mutex_counter -= 1;
         pthread_mutex_unlock(&search_flag_mutex);
     }
-    if ((Rebuild_Ptr == nullptr) || root->right_son_ptr != *Rebuild_Ptr){
+    if (!rebuild_owns(root->right_son_ptr)){
         Search_by_range(root->right_son_ptr, boxpoint, Storage);
     } else {
+        // Same protocol as Search: the rebuild thread sets the counter to -1 while it swaps and frees this subtree
         pthread_mutex_lock(&search_flag_mutex);
+        while (search_mutex_counter == -1)
+        {
+            pthread_mutex_unlock(&search_flag_mutex);
+            usleep(1);
+            pthread_mutex_lock(&search_flag_mutex);
+        }
+        search_mutex_counter += 1;
+        pthread_mutex_unlock(&search_flag_mutex);
         Search_by_range(root->right_son_ptr, boxpoint, Storage);
+        pthread_mutex_lock(&search_flag_mutex);
+        search_mutex_counter -= 1;
         pthread_mutex_unlock(&search_flag_mutex);
     }
     return;    
@@ -1041,7 +1241,7 @@ void KD_TREE::Push_Down(KD_TREE_NODE *root){
     operation.tree_deleted = root->tree_deleted;
     operation.tree_downsample_deleted = root->tree_downsample_deleted;
     if (root->need_push_down_to_left && root->left_son_ptr != nullptr){
-        if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->left_son_ptr){
+        if (!rebuild_owns(root->left_son_ptr)){
             root->left_son_ptr->tree_downsample_deleted |= root->tree_downsample_deleted;
             root->left_son_ptr->point_downsample_deleted |= root->tree_downsample_deleted;
             root->left_son_ptr->tree_deleted = root->tree_deleted || root->left_son_ptr->tree_downsample_deleted;
@@ -1073,7 +1273,7 @@ void KD_TREE::Push_Down(KD_TREE_NODE *root){
         }
     }
     if (root->need_push_down_to_right && root->right_son_ptr != nullptr){
-        if (Rebuild_Ptr == nullptr || *Rebuild_Ptr != root->right_son_ptr){
+        if (!rebuild_owns(root->right_son_ptr)){
             root->right_son_ptr->tree_downsample_deleted |= root->tree_downsample_deleted;
             root->right_son_ptr->point_downsample_deleted |= root->tree_downsample_deleted;
             root->right_son_ptr->tree_deleted = root->tree_deleted || root->right_son_ptr->tree_downsample_deleted;
@@ -1284,6 +1484,147 @@ void KD_TREE::delete_tree_nodes(KD_TREE_NODE ** root){
     return;
 }
 
+void KD_TREE::order_snapshot(int l, int r, PointVector & Storage, vector<uint8_t> & axis){
+    if (l>r) return;
+    int mid = (l+r)>>1;
+    axis[mid] = divide_by_longest_axis(l, r, Storage);
+    order_snapshot(l, mid-1, Storage, axis);
+    order_snapshot(mid+1, r, Storage, axis);
+}
+
+void KD_TREE::build_from_snapshot(KD_TREE_NODE ** root, int l, int r, const float * xyz, const float * attributes, const uint8_t * axis){
+    if (l>r) return;
+    *root = new KD_TREE_NODE;
+    InitTreeNode(*root);
+    int mid = (l+r)>>1;
+    (*root)->division_axis = axis[mid];
+    (*root)->point.x = xyz[3*mid];
+    (*root)->point.y = xyz[3*mid+1];
+    (*root)->point.z = xyz[3*mid+2];
+    if (attributes != nullptr){
+        (*root)->point.intensity = attributes[5*mid];
+        (*root)->point.normal_x = attributes[5*mid+1];
+        (*root)->point.normal_y = attributes[5*mid+2];
+        (*root)->point.normal_z = attributes[5*mid+3];
+        (*root)->point.curvature = attributes[5*mid+4];
+    }
+    KD_TREE_NODE * left_son = nullptr, * right_son = nullptr;
+    build_from_snapshot(&left_son, l, mid-1, xyz, attributes, axis);
+    build_from_snapshot(&right_son, mid+1, r, xyz, attributes, axis);
+    (*root)->left_son_ptr = left_son;
+    (*root)->right_son_ptr = right_son;
+    Update((*root));
+}
+
+bool KD_TREE::write_snapshot(const string & file_name, PointVector & points, bool save_attributes){
+    int n = points.size();
+    vector<uint8_t> axis(n);
+    order_snapshot(0, n-1, points, axis);
+    vector<float> xyz(3*n), attributes(save_attributes ? 5*n : 0);
+    for (int i = 0; i < n; i++){
+        xyz[3*i] = points[i].x;
+        xyz[3*i+1] = points[i].y;
+        xyz[3*i+2] = points[i].z;
+        if (!save_attributes) continue;
+        attributes[5*i] = points[i].intensity;
+        attributes[5*i+1] = points[i].normal_x;
+        attributes[5*i+2] = points[i].normal_y;
+        attributes[5*i+3] = points[i].normal_z;
+        attributes[5*i+4] = points[i].curvature;
+    }
+    IKD_SNAPSHOT_HEADER header;
+    header.magic = IKD_SNAPSHOT_MAGIC;
+    header.version = IKD_SNAPSHOT_VERSION;
+    header.point_num = n;
+    header.with_attributes = save_attributes ? 1 : 0;
+    FILE * fp = fopen(file_name.c_str(), "wb");
+    if (fp == nullptr) return false;
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    ok = ok && fwrite(xyz.data(), sizeof(float), xyz.size(), fp) == xyz.size();
+    ok = ok && fwrite(attributes.data(), sizeof(float), attributes.size(), fp) == attributes.size();
+    ok = ok && fwrite(axis.data(), sizeof(uint8_t), axis.size(), fp) == axis.size();
+    ok = (fclose(fp) == 0) && ok;
+    return ok;
+}
+
+// Map the snapshot file read-only, returns nullptr if the file is missing or not a valid snapshot
+static const IKD_SNAPSHOT_HEADER * map_snapshot(const string & file_name, size_t & file_size){
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < sizeof(IKD_SNAPSHOT_HEADER)){
+        close(fd);
+        return nullptr;
+    }
+    file_size = st.st_size;
+    void * data = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return nullptr;
+    const IKD_SNAPSHOT_HEADER * header = (const IKD_SNAPSHOT_HEADER *) data;
+    size_t n = header->point_num;
+    size_t expect_size = sizeof(IKD_SNAPSHOT_HEADER) + n * (header->with_attributes ? 8 : 3) * sizeof(float) + n * sizeof(uint8_t);
+    if (header->magic != IKD_SNAPSHOT_MAGIC || header->version != IKD_SNAPSHOT_VERSION || file_size != expect_size){
+        munmap(data, file_size);
+        return nullptr;
+    }
+    return header;
+}
+
+bool KD_TREE::save_snapshot(const string & file_name, bool save_attributes){
+    PointVector storage;
+    // Hold the rebuild lock so that the rebuild thread does not swap out a subtree while flattening
+    pthread_mutex_lock(&rebuild_ptr_mutex_lock);
+    flatten(Root_Node, storage, NOT_RECORD);
+    pthread_mutex_unlock(&rebuild_ptr_mutex_lock);
+    return write_snapshot(file_name, storage, save_attributes);
+}
+
+bool KD_TREE::load_snapshot(const string & file_name){
+    size_t file_size = 0;
+    const IKD_SNAPSHOT_HEADER * header = map_snapshot(file_name, file_size);
+    if (header == nullptr) return false;
+    int n = header->point_num;
+    const float * xyz = (const float *)(header + 1);
+    const float * attributes = header->with_attributes ? xyz + 3*n : nullptr;
+    const uint8_t * axis = (const uint8_t *)(xyz + (header->with_attributes ? 8 : 3) * n);
+    if (Root_Node != nullptr){
+        delete_tree_nodes(&Root_Node);
+    }
+    if (n > 0){
+        STATIC_ROOT_NODE = new KD_TREE_NODE;
+        InitTreeNode(STATIC_ROOT_NODE);
+        build_from_snapshot(&STATIC_ROOT_NODE->left_son_ptr, 0, n-1, xyz, attributes, axis);
+        Update(STATIC_ROOT_NODE);
+        STATIC_ROOT_NODE->TreeSize = 0;
+        Root_Node = STATIC_ROOT_NODE->left_son_ptr;
+    }
+    munmap((void *) header, file_size);
+    return true;
+}
+
+bool KD_TREE::read_snapshot(const string & file_name, PointVector & points){
+    size_t file_size = 0;
+    const IKD_SNAPSHOT_HEADER * header = map_snapshot(file_name, file_size);
+    if (header == nullptr) return false;
+    int n = header->point_num;
+    const float * xyz = (const float *)(header + 1);
+    const float * attributes = header->with_attributes ? xyz + 3*n : nullptr;
+    points.resize(n);
+    for (int i = 0; i < n; i++){
+        points[i].x = xyz[3*i];
+        points[i].y = xyz[3*i+1];
+        points[i].z = xyz[3*i+2];
+        if (attributes == nullptr) continue;
+        points[i].intensity = attributes[5*i];
+        points[i].normal_x = attributes[5*i+1];
+        points[i].normal_y = attributes[5*i+2];
+        points[i].normal_z = attributes[5*i+3];
+        points[i].curvature = attributes[5*i+4];
+    }
+    munmap((void *) header, file_size);
+    return true;
+}
+
 bool KD_TREE::same_point(PointType a, PointType b){
     return (fabs(a.x-b.x) < EPSS && fabs(a.y-b.y) < EPSS && fabs(a.z-b.z) < EPSS );
 }
@@ -7,6 +7,9 @@
 #include <pthread.h>
 #include <chrono>
 #include <time.h>
+#include <string>
+#include <atomic>
+#include "task_scheduler.h"
 
 
 #define EPSS 1e-6
@@ -15,6 +18,8 @@
 #define DOWNSAMPLE_SWITCH true
 #define ForceRebuildPercentage 0.2
 #define Q_LEN 1000000
+#define IKD_SNAPSHOT_MAGIC 0x54444b49  // "IKDT"
+#define IKD_SNAPSHOT_VERSION 1
 
 using namespace std;
 
@@ -69,6 +74,16 @@ enum operation_set {ADD_POINT, DELETE_POINT, DELETE_BOX, ADD_BOX, DOWNSAMPLE_DEL
 
 enum delete_point_storage_set {NOT_RECORD, DELETE_POINTS_REC, MULTI_THREAD_REC};
 
+// Snapshot file: header, xyz[3n], optional attributes[5n] (intensity, normal_x/y/z, curvature), division axis[n].
+// Points are stored in the order BuildTree visits them, so node mid of [l,r] is the root of that range
+// and the tree is rebuilt in O(n) without any median search.
+struct IKD_SNAPSHOT_HEADER{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t point_num;
+    uint32_t with_attributes;
+};
+
 struct Operation_Logger_Type{
     PointType point;
     BoxPointType boxpoint;
@@ -124,8 +139,14 @@ private:
     PointVector Rebuild_PCL_Storage;
     KD_TREE_NODE ** Rebuild_Ptr;
     int search_mutex_counter = 0;
+    // Rebuilds run as TASK_MAP jobs on the scheduler when one is set, otherwise on the polling thread
+    TaskScheduler * rebuild_scheduler = nullptr;
+    bool rebuild_submitted = false;  // protected by rebuild_ptr_mutex_lock
     static void * multi_thread_ptr(void *arg);
     void multi_thread_rebuild();
+    void rebuild_once();
+    void submit_rebuild();
+    void rebuild_task();
     void start_thread();
     void stop_thread();
     void run_operation(KD_TREE_NODE ** root, Operation_Logger_Type operation);
@@ -142,7 +163,10 @@ private:
     PointVector Multithread_Points_deleted;
     void InitTreeNode(KD_TREE_NODE * root);
     void Test_Lock_States(KD_TREE_NODE *root);
+    static int divide_by_longest_axis(int l, int r, PointVector & Storage);
     void BuildTree(KD_TREE_NODE ** root, int l, int r, PointVector & Storage);
+    static void order_snapshot(int l, int r, PointVector & Storage, vector<uint8_t> & axis);
+    void build_from_snapshot(KD_TREE_NODE ** root, int l, int r, const float * xyz, const float * attributes, const uint8_t * axis);
     void Rebuild(KD_TREE_NODE ** root);
     int Delete_by_range(KD_TREE_NODE ** root, BoxPointType boxpoint, bool allow_rebuild, bool is_downsample);
     void Delete_by_point(KD_TREE_NODE ** root, PointType point, bool allow_rebuild);
@@ -150,6 +174,7 @@ private:
     void Add_by_range(KD_TREE_NODE ** root, BoxPointType boxpoint, bool allow_rebuild);
     void Search(KD_TREE_NODE * root, int k_nearest, PointType point, MANUAL_HEAP &q, double max_dist);//priority_queue<PointType_CMP>
     void Search_by_range(KD_TREE_NODE *root, BoxPointType boxpoint, PointVector &Storage);
+    bool rebuild_owns(KD_TREE_NODE * const & son_ptr);
     bool Criterion_Check(KD_TREE_NODE * root);
     void Push_Down(KD_TREE_NODE * root);
     void Update(KD_TREE_NODE * root); 
@@ -170,17 +195,24 @@ public:
     void Set_balance_criterion_param(float balance_param);
     void set_downsample_param(float box_length);
     void InitializeKDTree(float delete_param = 0.5, float balance_param = 0.7, float box_length = 0.2); 
+    void Set_Scheduler(TaskScheduler * scheduler);
     int size();
     int validnum();
     void root_alpha(float &alpha_bal, float &alpha_del);
     void Build(PointVector point_cloud);
     void Nearest_Search(PointType point, int k_nearest, PointVector &Nearest_Points, vector<float> & Point_Distance, double max_dist = INFINITY);
+    void Box_Search(const BoxPointType &Box_of_Point, PointVector &Storage);
     int Add_Points(PointVector & PointToAdd, bool downsample_on);
+    int Add_Points_Batch(PointVector & PointToAdd, PointVector * Points_Added = nullptr, PointVector * Points_Removed = nullptr);
     void Add_Point_Boxes(vector<BoxPointType> & BoxPoints);
     void Delete_Points(PointVector & PointToDel);
     int Delete_Point_Boxes(vector<BoxPointType> & BoxPoints);
     void flatten(KD_TREE_NODE * root, PointVector &Storage, delete_point_storage_set storage_type);
     void acquire_removed_points(PointVector & removed_points);
+    bool save_snapshot(const string & file_name, bool save_attributes = true);
+    bool load_snapshot(const string & file_name);
+    static bool write_snapshot(const string & file_name, PointVector & points, bool save_attributes);
+    static bool read_snapshot(const string & file_name, PointVector & points);
     void print_tree(int index, FILE *fp, float x_min, float x_max, float y_min, float y_max, float z_min, float z_max);
     BoxPointType tree_range();
     PointVector PCL_Storage;     
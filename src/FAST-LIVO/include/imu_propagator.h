@@ -0,0 +1,56 @@
+#ifndef IMU_PROPAGATOR_H
+#define IMU_PROPAGATOR_H
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <ros/ros.h>
+#include <common_lib.h>
+
+/// *************IMU-rate odometry predicted from the last filter update
+//; 后台线程从最近一次LIO/VIO更新后的状态开始，每来一个IMU就做一次和UndistortPcl一样的中值积分，发布IMU频率的位姿
+//; 滤波器更新后只把新状态交给线程(set_anchor)，线程自己用缓存的IMU追到当前时刻，不阻塞主线程
+class ImuPropagator
+{
+public:
+    ImuPropagator();
+    ~ImuPropagator();
+
+    void init(const ros::Publisher &pub_odom);
+    void push_imu(const sensor_msgs::Imu::ConstPtr &msg);  //; imu_cbk里调用
+    void set_anchor(const StatesGroup &state, double time, double acc_scale);  //; 滤波器更新后调用，time是state对应的时刻
+
+    //; 线程里更新，退出时主线程读取
+    std::atomic<long> published_num;  //; 发布的位姿数
+    std::atomic<double> aver_lag;     //; 发布时刻相对IMU时间戳的平均延迟(s)
+
+private:
+    //; 只保留积分用到的状态，不拷贝协方差
+    struct PropState
+    {
+        M3D rot;
+        V3D pos, vel, bias_g, bias_a, gravity;
+    };
+
+    void run();
+    bool propagate(const sensor_msgs::Imu::ConstPtr &head, const sensor_msgs::Imu::ConstPtr &tail);
+    void publish(double stamp);
+
+    ros::Publisher pub;
+    bool running;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable sig;
+    deque<sensor_msgs::Imu::ConstPtr> imu_new;      //; 还没处理的IMU
+    bool anchor_new;
+    PropState anchor;
+    double anchor_time, anchor_acc_scale;
+
+    //; 以下只在线程里用
+    deque<sensor_msgs::Imu::ConstPtr> imu_history;  //; anchor之后的IMU(加上anchor之前的一个)，重新锚定时用来重新积分
+    PropState cur;
+    double cur_time, acc_scale;
+    bool anchored;
+};
+#endif
@@ -0,0 +1,261 @@
+#include "ivox.h"
+
+IVox::IVox(float resolution_param, int nearby_type, int capacity_param) {
+    resolution = resolution_param;
+    inv_resolution = 1.0f / resolution;
+    capacity = capacity_param;
+    generate_nearby_grids(nearby_type);
+}
+
+IVox::~IVox()
+{
+    grids_map.clear();
+    grids_cache.clear();
+    PointVector ().swap(Points_deleted);
+    PointVector ().swap(Points_evicted);
+}
+
+void IVox::set_downsample_param(float box_length){
+    downsample_size = box_length;
+}
+
+int IVox::size(){
+    return point_num;
+}
+
+int IVox::voxel_num(){
+    return grids_map.size();
+}
+
+IVOX_KEY IVox::pos_to_key(float x, float y, float z) const{
+    return IVOX_KEY(int(floor(x * inv_resolution)), int(floor(y * inv_resolution)), int(floor(z * inv_resolution)));
+}
+
+void IVox::generate_nearby_grids(int nearby_type){
+    nearby_grids.clear();
+    nearby_grids.push_back(IVOX_KEY(0, 0, 0));
+    if (nearby_type == NEARBY_CENTER) return;
+    for (int dx = -1; dx <= 1; dx++)
+        for (int dy = -1; dy <= 1; dy++)
+            for (int dz = -1; dz <= 1; dz++){
+                int n = abs(dx) + abs(dy) + abs(dz);
+                if (n == 0) continue;
+                // 6邻域: 共面; 18邻域: 共面+共边; 26邻域: 全部
+                if (n == 1 || (n == 2 && nearby_type >= NEARBY18) || (n == 3 && nearby_type >= NEARBY26))
+                    nearby_grids.push_back(IVOX_KEY(dx, dy, dz));
+            }
+}
+
+void IVox::evict(){
+    while (int(grids_map.size()) > capacity){
+        IVOX_NODE &node = grids_cache.back().second;
+        for (int i = 0; i < node.points.size(); i++) Points_evicted.push_back(node.points[i]);
+        point_num -= node.points.size();
+        grids_map.erase(grids_cache.back().first);
+        grids_cache.pop_back();
+    }
+}
+
+void IVox::insert_point(const PointType &point){
+    IVOX_KEY key = pos_to_key(point.x, point.y, point.z);
+    auto iter = grids_map.find(key);
+    if (iter == grids_map.end()){
+        grids_cache.push_front(std::make_pair(key, IVOX_NODE()));
+        grids_map[key] = grids_cache.begin();
+        grids_cache.front().second.points.push_back(point);
+        point_num ++;
+        evict();
+        return;
+    }
+    grids_cache.splice(grids_cache.begin(), grids_cache, iter->second);
+    iter->second->second.points.push_back(point);
+    point_num ++;
+}
+
+bool IVox::add_point(const PointType &point, bool downsample_on, PointVector *Points_Added, PointVector *Points_Removed){
+    if (!downsample_on){
+        insert_point(point);
+        if (Points_Added != nullptr) Points_Added->push_back(point);
+        return true;
+    }
+    // 和ikd-Tree一样, 每个降采样格子里只保留离格子中心最近的点
+    // 格子和iVox体素的边界不对齐, 一个格子可能跨好几个体素, 要把格子覆盖的体素都查一遍
+    float ix = floor(point.x / downsample_size), iy = floor(point.y / downsample_size), iz = floor(point.z / downsample_size);
+    float cx = (ix + 0.5f) * downsample_size, cy = (iy + 0.5f) * downsample_size, cz = (iz + 0.5f) * downsample_size;
+    IVOX_KEY key_min = pos_to_key(ix * downsample_size, iy * downsample_size, iz * downsample_size);
+    IVOX_KEY key_max = pos_to_key((ix + 1) * downsample_size, (iy + 1) * downsample_size, (iz + 1) * downsample_size);
+    PointType result = point;
+    float min_dist = (point.x - cx) * (point.x - cx) + (point.y - cy) * (point.y - cy) + (point.z - cz) * (point.z - cz);
+    bool result_is_new = true;
+    int cell_num = 0;
+    for (int x = key_min.x; x <= key_max.x; x++)
+        for (int y = key_min.y; y <= key_max.y; y++)
+            for (int z = key_min.z; z <= key_max.z; z++){
+                auto iter = grids_map.find(IVOX_KEY(x, y, z));
+                if (iter == grids_map.end()) continue;
+                const PointVector &points = iter->second->second.points;
+                for (int i = 0; i < points.size(); i++){
+                    const PointType &p = points[i];
+                    if (floor(p.x / downsample_size) != ix || floor(p.y / downsample_size) != iy || floor(p.z / downsample_size) != iz) continue;
+                    cell_num ++;
+                    float d = (p.x - cx) * (p.x - cx) + (p.y - cy) * (p.y - cy) + (p.z - cz) * (p.z - cz);
+                    if (d < min_dist){
+                        min_dist = d;
+                        result = p;
+                        result_is_new = false;
+                    }
+                }
+            }
+    if (cell_num == 1 && !result_is_new) return false;
+    // 格子里原有的点全部删掉, 再放入保留的点, 和ikd-Tree的Delete_by_range + Add_by_point一样
+    if (cell_num > 0){
+        for (int x = key_min.x; x <= key_max.x; x++)
+            for (int y = key_min.y; y <= key_max.y; y++)
+                for (int z = key_min.z; z <= key_max.z; z++){
+                    auto iter = grids_map.find(IVOX_KEY(x, y, z));
+                    if (iter == grids_map.end()) continue;
+                    PointVector &points = iter->second->second.points;
+                    int n = 0;
+                    for (int i = 0; i < points.size(); i++){
+                        const PointType &p = points[i];
+                        if (floor(p.x / downsample_size) != ix || floor(p.y / downsample_size) != iy || floor(p.z / downsample_size) != iz){
+                            points[n++] = p;
+                        } else if (Points_Removed != nullptr){
+                            Points_Removed->push_back(p);
+                        }
+                    }
+                    point_num -= points.size() - n;
+                    points.resize(n);
+                    if (points.empty()){
+                        grids_cache.erase(iter->second);
+                        grids_map.erase(iter);
+                    }
+                }
+    }
+    insert_point(result);
+    if (Points_Added != nullptr) Points_Added->push_back(result);
+    return true;
+}
+
+void IVox::Build(PointVector &point_cloud){
+    grids_map.clear();
+    grids_cache.clear();
+    point_num = 0;
+    for (int i = 0; i < point_cloud.size(); i++) insert_point(point_cloud[i]);
+}
+
+void IVox::Nearest_Search(const PointType &point, int k_nearest, PointVector &Nearest_Points, vector<float> &Point_Distance, double max_dist){
+    float best_dist[IVOX_MAX_K];
+    const PointType *best_point[IVOX_MAX_K];
+    int k = min(k_nearest, IVOX_MAX_K);
+    int found = 0;
+    float max_dist_sq = std::isinf(max_dist) ? INFINITY : float(max_dist * max_dist);
+    IVOX_KEY key = pos_to_key(point.x, point.y, point.z);
+    for (int g = 0; g < nearby_grids.size(); g++){
+        auto iter = grids_map.find(IVOX_KEY(key.x + nearby_grids[g].x, key.y + nearby_grids[g].y, key.z + nearby_grids[g].z));
+        if (iter == grids_map.end()) continue;
+        const PointVector &points = iter->second->second.points;
+        for (int i = 0; i < points.size(); i++){
+            float dx = points[i].x - point.x, dy = points[i].y - point.y, dz = points[i].z - point.z;
+            float dist = dx * dx + dy * dy + dz * dz;
+            if (dist >= max_dist_sq || (found == k && dist >= best_dist[k - 1])) continue;
+            // 插入排序, k很小(一般是5)
+            int j = found < k ? found++ : k - 1;
+            while (j > 0 && best_dist[j - 1] > dist){
+                best_dist[j] = best_dist[j - 1];
+                best_point[j] = best_point[j - 1];
+                j--;
+            }
+            best_dist[j] = dist;
+            best_point[j] = &points[i];
+        }
+    }
+    Nearest_Points.clear();
+    Point_Distance.clear();
+    for (int i = 0; i < found; i++){
+        Nearest_Points.push_back(*best_point[i]);
+        Point_Distance.push_back(best_dist[i]);
+    }
+}
+
+int IVox::Add_Points(PointVector &PointToAdd, bool downsample_on, PointVector *Points_Added, PointVector *Points_Removed){
+    int counter = 0;
+    for (int i = 0; i < PointToAdd.size(); i++){
+        if (add_point(PointToAdd[i], downsample_on, Points_Added, Points_Removed)) counter ++;
+    }
+    return counter;
+}
+
+int IVox::Delete_Point_Boxes(vector<BoxPointType> &BoxPoints){
+    int counter = 0;
+    for (auto it = grids_cache.begin(); it != grids_cache.end();){
+        const IVOX_KEY &key = it->first;
+        float vmin[3] = {key.x * resolution, key.y * resolution, key.z * resolution};
+        PointVector &points = it->second.points;
+        for (int b = 0; b < BoxPoints.size(); b++){
+            const BoxPointType &box = BoxPoints[b];
+            bool overlap = true;
+            for (int i = 0; i < 3; i++){
+                if (vmin[i] + resolution < box.vertex_min[i] || vmin[i] > box.vertex_max[i]) overlap = false;
+            }
+            if (!overlap) continue;
+            int n = 0;
+            for (int i = 0; i < points.size(); i++){
+                const PointType &p = points[i];
+                if (p.x >= box.vertex_min[0] && p.x <= box.vertex_max[0] && p.y >= box.vertex_min[1] && p.y <= box.vertex_max[1] &&
+                    p.z >= box.vertex_min[2] && p.z <= box.vertex_max[2]){
+                    Points_deleted.push_back(p);
+                } else {
+                    points[n++] = p;
+                }
+            }
+            counter += points.size() - n;
+            point_num -= points.size() - n;
+            points.resize(n);
+        }
+        if (points.empty()){
+            grids_map.erase(key);
+            it = grids_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return counter;
+}
+
+void IVox::acquire_removed_points(PointVector &removed_points){
+    for (int i = 0; i < Points_deleted.size(); i++) removed_points.push_back(Points_deleted[i]);
+    Points_deleted.clear();
+}
+
+void IVox::acquire_evicted_points(PointVector &evicted_points){
+    for (int i = 0; i < Points_evicted.size(); i++) evicted_points.push_back(Points_evicted[i]);
+    Points_evicted.clear();
+}
+
+// 只查盒子覆盖的体素, 不改变LRU顺序
+void IVox::Box_Search(const BoxPointType &Box_of_Point, PointVector &Storage){
+    Storage.clear();
+    IVOX_KEY key_min = pos_to_key(Box_of_Point.vertex_min[0], Box_of_Point.vertex_min[1], Box_of_Point.vertex_min[2]);
+    IVOX_KEY key_max = pos_to_key(Box_of_Point.vertex_max[0], Box_of_Point.vertex_max[1], Box_of_Point.vertex_max[2]);
+    for (int x = key_min.x; x <= key_max.x; x++)
+        for (int y = key_min.y; y <= key_max.y; y++)
+            for (int z = key_min.z; z <= key_max.z; z++){
+                auto iter = grids_map.find(IVOX_KEY(x, y, z));
+                if (iter == grids_map.end()) continue;
+                const PointVector &points = iter->second->second.points;
+                for (int i = 0; i < points.size(); i++){
+                    const PointType &p = points[i];
+                    if (p.x >= Box_of_Point.vertex_min[0] && p.x <= Box_of_Point.vertex_max[0] && p.y >= Box_of_Point.vertex_min[1] && p.y <= Box_of_Point.vertex_max[1] &&
+                        p.z >= Box_of_Point.vertex_min[2] && p.z <= Box_of_Point.vertex_max[2])
+                        Storage.push_back(p);
+                }
+            }
+}
+
+void IVox::flatten(PointVector &Storage){
+    Storage.reserve(Storage.size() + point_num);
+    for (auto it = grids_cache.begin(); it != grids_cache.end(); ++it){
+        Storage.insert(Storage.end(), it->second.points.begin(), it->second.points.end());
+    }
+}
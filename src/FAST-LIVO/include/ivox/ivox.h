@@ -0,0 +1,69 @@
+#pragma once
+#include <pcl/point_types.h>
+#include <Eigen/StdVector>
+#include <stdio.h>
+#include <math.h>
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include "ikd-Tree/ikd_Tree.h"
+
+// 增量式哈希体素地图(iVox): 每个体素只存一个小的点数组, 近邻搜索只查询周围的体素,
+// 插入和查询都是均摊O(1), 体素数量超过容量时按LRU淘汰最久没有访问的体素
+#define IVOX_DEFAULT_CAPACITY 1000000
+#define IVOX_MAX_K 32
+
+struct IVOX_KEY{
+    int x, y, z;
+    IVOX_KEY(int vx = 0, int vy = 0, int vz = 0) : x(vx), y(vy), z(vz) {}
+    bool operator == (const IVOX_KEY &other) const{
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct IVOX_KEY_HASH{
+    size_t operator()(const IVOX_KEY &k) const{
+        return size_t(((int64_t(k.x) * 73856093) ^ (int64_t(k.y) * 471943) ^ (int64_t(k.z) * 83492791)) % 10000000);
+    }
+};
+
+struct IVOX_NODE{
+    PointVector points;
+};
+
+enum ivox_nearby_set {NEARBY_CENTER = 0, NEARBY6 = 6, NEARBY18 = 18, NEARBY26 = 26};
+
+class IVox
+{
+private:
+    typedef std::list<std::pair<IVOX_KEY, IVOX_NODE>> GridList;
+    float resolution = 0.5f, inv_resolution = 2.0f;
+    float downsample_size = 0.2f;
+    int capacity = IVOX_DEFAULT_CAPACITY;
+    int point_num = 0;
+    std::vector<IVOX_KEY> nearby_grids;
+    GridList grids_cache;   // 最近访问的体素在前面
+    std::unordered_map<IVOX_KEY, GridList::iterator, IVOX_KEY_HASH> grids_map;
+    PointVector Points_deleted;   // 盒子删除的点
+    PointVector Points_evicted;   // LRU淘汰的点, 和盒子删除分开, 调用者不能把它们再加回地图
+    IVOX_KEY pos_to_key(float x, float y, float z) const;
+    void generate_nearby_grids(int nearby_type);
+    void insert_point(const PointType &point);
+    bool add_point(const PointType &point, bool downsample_on, PointVector *Points_Added, PointVector *Points_Removed);
+    void evict();
+
+public:
+    IVox(float resolution_param = 0.5, int nearby_type = NEARBY18, int capacity_param = IVOX_DEFAULT_CAPACITY);
+    ~IVox();
+    void set_downsample_param(float box_length);
+    int size();
+    int voxel_num();
+    void Build(PointVector &point_cloud);
+    void Nearest_Search(const PointType &point, int k_nearest, PointVector &Nearest_Points, vector<float> &Point_Distance, double max_dist = INFINITY);
+    int Add_Points(PointVector &PointToAdd, bool downsample_on, PointVector *Points_Added = nullptr, PointVector *Points_Removed = nullptr);
+    int Delete_Point_Boxes(vector<BoxPointType> &BoxPoints);
+    void acquire_removed_points(PointVector &removed_points);
+    void acquire_evicted_points(PointVector &evicted_points);
+    void Box_Search(const BoxPointType &Box_of_Point, PointVector &Storage);
+    void flatten(PointVector &Storage);
+};
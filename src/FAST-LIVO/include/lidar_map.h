@@ -0,0 +1,124 @@
+#ifndef LIDAR_MAP_H
+#define LIDAR_MAP_H
+
+#include <memory>
+#include <ikd-Tree/ikd_Tree.h>
+#include <ivox/ivox.h>
+
+//; LIO使用的地图后端, 通过参数 mapping/map_backend 选择
+enum MAP_BACKEND
+{
+    MAP_IKDTREE = 0,
+    MAP_IVOX = 1
+};
+
+//; 地图的抽象接口, laserMapping里面只通过这个接口访问地图
+class LidarMap
+{
+public:
+    virtual ~LidarMap() {}
+    virtual const char *name() const = 0;
+    virtual bool empty() = 0;
+    virtual int size() = 0;
+    virtual void set_downsample_param(float box_length) = 0;
+    virtual void set_scheduler(TaskScheduler *scheduler) = 0; //; 地图维护的后台任务放到线程池
+    virtual void Build(PointVector &points) = 0;
+    virtual void Nearest_Search(const PointType &point, int k_nearest, PointVector &nearest_points,
+                                vector<float> &point_distance) = 0;
+    //; points_added/points_removed: 降采样之后地图里真正加进去的点和被替换掉的点，不需要时传nullptr
+    virtual int Add_Points(PointVector &points, bool downsample_on, PointVector *points_added = nullptr,
+                           PointVector *points_removed = nullptr) = 0;
+    virtual int Delete_Point_Boxes(vector<BoxPointType> &boxes) = 0;
+    virtual void Add_Point_Boxes(vector<BoxPointType> &boxes) = 0;
+    virtual void acquire_removed_points(PointVector &removed_points) = 0;   //; 盒子删除后真正从地图里删掉的点
+    virtual void acquire_evicted_points(PointVector &evicted_points) = 0;   //; 容量淘汰的点，不能再加回地图
+    virtual void Box_Search(const BoxPointType &box, PointVector &storage) = 0;
+    virtual void flatten(PointVector &storage) = 0;
+    //; 地图快照，文件格式见ikd_Tree.h，两种后端的文件通用
+    virtual bool save_snapshot(const string &file_name, bool save_attributes) = 0;
+    virtual bool load_snapshot(const string &file_name) = 0;
+};
+
+class IkdTreeMap : public LidarMap
+{
+public:
+    KD_TREE tree;
+
+    const char *name() const { return "ikd-Tree"; }
+    bool empty() { return tree.Root_Node == nullptr; }
+    int size() { return tree.size(); }
+    void set_downsample_param(float box_length) { tree.set_downsample_param(box_length); }
+    //; 子树重建作为TASK_MAP任务提交，不再用轮询的重建线程
+    void set_scheduler(TaskScheduler *scheduler) { tree.Set_Scheduler(scheduler); }
+    void Build(PointVector &points) { tree.Build(points); }
+    void Nearest_Search(const PointType &point, int k_nearest, PointVector &nearest_points, vector<float> &point_distance)
+    {
+        tree.Nearest_Search(point, k_nearest, nearest_points, point_distance);
+    }
+    int Add_Points(PointVector &points, bool downsample_on, PointVector *points_added = nullptr, PointVector *points_removed = nullptr)
+    {
+        //; 降采样插入按体素批量处理，每个体素只做一次范围搜索
+        if (downsample_on)
+            return tree.Add_Points_Batch(points, points_added, points_removed);
+        if (points_added != nullptr)
+            points_added->insert(points_added->end(), points.begin(), points.end());
+        return tree.Add_Points(points, false);
+    }
+    int Delete_Point_Boxes(vector<BoxPointType> &boxes) { return tree.Delete_Point_Boxes(boxes); }
+    void Add_Point_Boxes(vector<BoxPointType> &boxes) { tree.Add_Point_Boxes(boxes); }
+    void acquire_removed_points(PointVector &removed_points) { tree.acquire_removed_points(removed_points); }
+    //; ikd-Tree没有容量上限，不会淘汰点
+    void acquire_evicted_points(PointVector &evicted_points) {}
+    void Box_Search(const BoxPointType &box, PointVector &storage) { tree.Box_Search(box, storage); }
+    void flatten(PointVector &storage) { tree.flatten(tree.Root_Node, storage, NOT_RECORD); }
+    bool save_snapshot(const string &file_name, bool save_attributes) { return tree.save_snapshot(file_name, save_attributes); }
+    bool load_snapshot(const string &file_name) { return tree.load_snapshot(file_name); }
+};
+
+class IVoxMap : public LidarMap
+{
+public:
+    IVox ivox;
+
+    IVoxMap(float resolution, int nearby_type) : ivox(resolution, nearby_type) {}
+    const char *name() const { return "iVox"; }
+    bool empty() { return ivox.size() == 0; }
+    int size() { return ivox.size(); }
+    void set_downsample_param(float box_length) { ivox.set_downsample_param(box_length); }
+    //; iVox插入时直接更新，没有后台任务
+    void set_scheduler(TaskScheduler *scheduler) {}
+    void Build(PointVector &points) { ivox.Build(points); }
+    void Nearest_Search(const PointType &point, int k_nearest, PointVector &nearest_points, vector<float> &point_distance)
+    {
+        ivox.Nearest_Search(point, k_nearest, nearest_points, point_distance);
+    }
+    int Add_Points(PointVector &points, bool downsample_on, PointVector *points_added = nullptr, PointVector *points_removed = nullptr)
+    {
+        return ivox.Add_Points(points, downsample_on, points_added, points_removed);
+    }
+    int Delete_Point_Boxes(vector<BoxPointType> &boxes) { return ivox.Delete_Point_Boxes(boxes); }
+    //; iVox删除的点马上就真正删掉了，都在acquire_removed_points里面，没有可以恢复的点
+    void Add_Point_Boxes(vector<BoxPointType> &boxes) {}
+    void acquire_removed_points(PointVector &removed_points) { ivox.acquire_removed_points(removed_points); }
+    void acquire_evicted_points(PointVector &evicted_points) { ivox.acquire_evicted_points(evicted_points); }
+    void Box_Search(const BoxPointType &box, PointVector &storage) { ivox.Box_Search(box, storage); }
+    void flatten(PointVector &storage) { ivox.flatten(storage); }
+    bool save_snapshot(const string &file_name, bool save_attributes)
+    {
+        PointVector storage;
+        ivox.flatten(storage);
+        return KD_TREE::write_snapshot(file_name, storage, save_attributes);
+    }
+    bool load_snapshot(const string &file_name)
+    {
+        PointVector storage;
+        if (!KD_TREE::read_snapshot(file_name, storage))
+            return false;
+        ivox.Build(storage);
+        return true;
+    }
+};
+
+typedef std::shared_ptr<LidarMap> LidarMapPtr;
+
+#endif
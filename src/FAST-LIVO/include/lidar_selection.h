@@ -12,7 +12,7 @@
 #include <vikit/robust_cost.h>
 #include <pcl/io/pcd_io.h>
 #include <pcl/point_types.h>
-#include <pcl/filters/voxel_grid.h>
+#include <voxel_downsample.h>
 #include <set>
 
 namespace lidar_selection
@@ -58,6 +58,7 @@ namespace lidar_selection
 
         Matrix<double, DIM_STATE, DIM_STATE> G, H_T_H; // 18*18
         MatrixXd H_sub, K;
+        InfoFormSolver info_solver;  //; 视觉更新的增益求解
         cv::flann::Index Kdtree;
 
         LidarSelector(const int grid_size, SparseMap *sparse_map);
@@ -120,7 +121,7 @@ namespace lidar_selection
         PointCloudXYZI::Ptr Map_points;
         PointCloudXYZI::Ptr Map_points_output;
         PointCloudXYZI::Ptr pg_down;
-        pcl::VoxelGrid<PointType> downSizeFilter;
+        VoxelDownsample downSizeFilter;
         // 这里用到了哈希表，自定义的体素类型作为键，
         unordered_map<VOXEL_KEY, VOXEL_POINTS *> feat_map;  //; 这个feat_map就是整个视觉地图，通过hash_key索引对应的体素
         unordered_map<VOXEL_KEY, float> sub_feat_map; //; 当前帧图像用到的子地图，每次都会重新构造，主要是用来索引，得到上面feat_map中的VOXEL_POINTS
@@ -0,0 +1,49 @@
+#ifndef MAP_INSERTER_H
+#define MAP_INSERTER_H
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <common_lib.h>
+
+/// *************Map insertion applied by a background thread in scan order
+//; 主线程更新完位姿就发布里程计，把这一帧的世界系点交给后台线程插入地图，增量更新不再占用关键路径
+//; 地图本身不是线程安全的，主线程访问地图(FOV裁剪到IEKF结束)之前调用acquire拿到地图锁；
+//; max_lag = 0时先等前面的帧全部插完，第k+1帧的近邻搜索一定能看到第k帧的点；max_lag > 0时允许最多落后几帧，落后的帧数记在staleness里
+class MapInserter
+{
+public:
+    typedef std::function<void(PointVector &)> Apply;  //; 把一帧世界系的点插入地图，只在后台线程里调用
+
+    MapInserter();
+    ~MapInserter();
+
+    void init(const Apply &apply_param);
+    void submit(PointVector &points);                       //; 交给后台线程，points被换走
+    std::unique_lock<std::mutex> acquire(int max_lag);      //; 等到未插入的帧数不超过max_lag，返回地图锁
+    void flush();                                           //; 等所有帧插完
+    int staleness() const { return stale_last; }            //; 上一次acquire时还没插入地图的帧数
+
+    long submit_num;                       //; 提交的帧数
+    std::atomic<long> insert_num;          //; 插入完成的帧数，后台线程更新，主线程随时读取
+    std::atomic<double> aver_insert_time;  //; 后台线程每帧插入的平均时间(s)
+    double aver_wait_time;                 //; acquire的平均等待时间(s)，以下都只在主线程里更新
+    double aver_stale;                     //; acquire时平均落后的帧数
+    int max_stale;
+
+private:
+    void run();
+
+    Apply apply;
+    bool running;
+    long acquire_num;
+    int stale_last;
+    std::thread worker;
+    std::mutex mtx;       //; 保护任务队列和计数
+    std::mutex map_mtx;   //; 保护地图，后台线程每插一帧拿一次
+    std::condition_variable sig, done;
+    std::deque<PointVector> tasks;
+};
+#endif
@@ -0,0 +1,45 @@
+#ifndef PLANE_CACHE_H
+#define PLANE_CACHE_H
+#include <unordered_map>
+#include <common_lib.h>
+#include <ikd-Tree/ikd_Tree.h>
+
+//; 每个体素的增量平面统计量，点加入地图时累加，查询时才重新拟合
+struct PlaneVoxel
+{
+    int n = 0;
+    V3D sum = V3D::Zero();
+    M3D sum_sq = M3D::Zero();
+    bool dirty = true;
+    bool is_plane = false;
+    Matrix<float, 4, 1, DontAlign> plane; //; 和esti_plane的输出一样: 单位法向量 + 截距，存在unordered_map里所以不对齐
+};
+
+/// *************Per-voxel plane cache for point-to-plane matching
+class PlaneCache
+{
+public:
+    PlaneCache();
+
+    void set_param(double voxel_size_param, int min_points_param, double max_thickness_param);
+    void Update(const PointVector &points_world);
+    void Remove(const PointVector &points_world);
+    bool Query(const PointType &point_world, VF(4) & pabcd);
+    void Delete_Boxes(const vector<BoxPointType> &boxes);
+    void Rebuild_Box(const BoxPointType &box, const PointVector &points_world);
+    void reset_counter();
+    int size() const { return voxels.size(); }
+
+    long query_num, hit_num; //; 查询次数和命中次数
+
+private:
+    VOXEL_KEY key_of(float x, float y, float z) const;
+    bool center_in_box(const VOXEL_KEY &key, const BoxPointType &box) const;
+    void fit(PlaneVoxel &v);
+
+    double voxel_size, inv_voxel_size;
+    int min_points;       //; 体素内至少多少个点才拟合平面
+    double max_thickness; //; 平面厚度(最小特征值开方)的阈值
+    unordered_map<VOXEL_KEY, PlaneVoxel> voxels;
+};
+#endif
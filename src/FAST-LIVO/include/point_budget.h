@@ -0,0 +1,32 @@
+#ifndef POINT_BUDGET_H
+#define POINT_BUDGET_H
+#include <common_lib.h>
+
+#define BUDGET_BIN_AZI (8) //; 选点时方向网格的方位角格数
+#define BUDGET_BIN_ELE (8) //; 俯仰角格数
+
+/// *************Adaptive point budget for the LIO update under a latency target
+//; 用前几帧实测的每点耗时估计这一帧能处理多少点(budget)，按budget调下采样分辨率；
+//; 分辨率调整慢一拍，超出budget的帧再按方向网格选点子集，稀疏方向的点全部保留，密集方向(比如地面)抽稀
+class PointBudget
+{
+public:
+    PointBudget();
+
+    void init(double deadline_param, double leaf_min_param, double leaf_max_param);
+    double leaf_size() const { return leaf; }  //; 下一帧的下采样分辨率
+    int budget() const;                         //; 这一帧最多处理的点数
+    bool select(PointCloudXYZI &points);        //; 点数超过budget时选出子集，返回是否裁剪
+    void update(int down_num, int used_num, double lio_time); //; LIO更新结束后调用，down_num是下采样后的点数，used_num是实际用的点数
+
+    int frame_num, miss_num, subset_num; //; 帧数、超时帧数、裁剪子集的帧数
+    double cost_per_point;               //; 每个点的平均耗时(s)
+    double leaf_aver;                    //; 平均下采样分辨率
+
+private:
+    double deadline, leaf, leaf_min, leaf_max;
+    vector<float> azi, ele, range;
+    vector<bool> keep;
+    vector<vector<int>> bins;
+};
+#endif
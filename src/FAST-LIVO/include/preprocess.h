@@ -2,6 +2,8 @@
 #include <pcl_conversions/pcl_conversions.h>
 #include <sensor_msgs/PointCloud2.h>
 #include <livox_ros_driver/CustomMsg.h>
+#include <atomic>
+#include "task_scheduler.h"
 
 using namespace std;
 
@@ -76,6 +78,65 @@ POINT_CLOUD_REGISTER_POINT_STRUCT(ouster_ros::Point,
     (std::uint32_t, range, range)
 )
 
+//; PointCloud2里用到的字段
+enum CloudField{F_X, F_Y, F_Z, F_INTENSITY, F_T, F_RING, F_NUM};
+
+//; 字段在每个点里的偏移和类型，按topic的布局只解析一次
+struct PointCloud2Layout
+{
+  uint32_t point_step = 0;
+  int offset[F_NUM];   //; -1表示没有这个字段，读出来是0
+  uint8_t type[F_NUM]; //; sensor_msgs::PointField::FLOAT32 等
+  vector<sensor_msgs::PointField> fields; //; 上一次解析的字段，用来判断布局有没有变
+};
+
+/// *************Read fields straight from sensor_msgs::PointCloud2::data, no pcl::fromROSMsg copy
+class PointCloud2View
+{
+  public:
+  PointCloud2View(const sensor_msgs::PointCloud2 &msg, const PointCloud2Layout &layout)
+      : data(msg.data.data()), lay(layout), point_step(layout.point_step), row_step(msg.row_step),
+        width(msg.width), num(size_t(msg.width) * msg.height), dense_rows(msg.row_step == msg.width * layout.point_step) {}
+
+  size_t size() const { return num; }
+  float x(size_t i) const { return get(i, F_X); }
+  float y(size_t i) const { return get(i, F_Y); }
+  float z(size_t i) const { return get(i, F_Z); }
+  float intensity(size_t i) const { return get(i, F_INTENSITY); }
+  double t(size_t i) const { return get(i, F_T); }
+  int ring(size_t i) const { return int(get(i, F_RING)); }
+
+  private:
+  inline const uint8_t *point(size_t i) const
+  {
+    return dense_rows ? data + i * point_step : data + (i / width) * row_step + (i % width) * point_step;
+  }
+  inline double get(size_t i, int f) const
+  {
+    if (lay.offset[f] < 0)
+      return 0;
+    const uint8_t *ptr = point(i) + lay.offset[f];
+    switch (lay.type[f])
+    {
+    case sensor_msgs::PointField::FLOAT32: { float v; memcpy(&v, ptr, 4); return v; }
+    case sensor_msgs::PointField::FLOAT64: { double v; memcpy(&v, ptr, 8); return v; }
+    case sensor_msgs::PointField::UINT8: return *ptr;
+    case sensor_msgs::PointField::INT8: return *(const int8_t *)ptr;
+    case sensor_msgs::PointField::UINT16: { uint16_t v; memcpy(&v, ptr, 2); return v; }
+    case sensor_msgs::PointField::INT16: { int16_t v; memcpy(&v, ptr, 2); return v; }
+    case sensor_msgs::PointField::UINT32: { uint32_t v; memcpy(&v, ptr, 4); return v; }
+    case sensor_msgs::PointField::INT32: { int32_t v; memcpy(&v, ptr, 4); return v; }
+    default: return 0;
+    }
+  }
+
+  const uint8_t *data;
+  const PointCloud2Layout &lay;
+  uint32_t point_step, row_step, width;
+  size_t num;
+  bool dense_rows; //; 行之间没有填充，按点的下标直接算偏移
+};
+
 class Preprocess
 {
   public:
@@ -92,9 +153,17 @@ class Preprocess
   PointCloudXYZI pl_full, pl_corn, pl_surf;
   PointCloudXYZI pl_buff[128]; //maximum 128 line lidar
   vector<orgtype> typess[128]; //maximum 128 line lidar
+  PointCloud2Layout cloud_layout; //; ouster/velodyne点云的字段布局
+  vector<uint8_t> pl_line; //; avia压缩后每个点的line
+  vector<uint64_t> sort_items, sort_tmp; //; 时间排序用的(key<<32 | 下标)
+  PointCloudXYZI line_surf[128], line_corn[128]; //每条line各自的特征输出，并行提取时互不干扰
   int lidar_type, point_filter_num, N_SCANS;;
   double blind;
   bool feature_enabled;
+  std::atomic<double> time_last, time_aver; //; 上一帧和平均的预处理时间(s)，开了ingest线程时在线程里更新、主线程读取
+  std::atomic<int> scan_num;
+  TaskScheduler *scheduler; //; 并行提取特征用的线程池，为空时串行
+  int task_priority;        //; 在后台线程预处理时降为TASK_MAP，让出给估计器
   ros::Publisher pub_full, pub_surf, pub_corn;
     
 
@@ -102,7 +171,11 @@ class Preprocess
   void avia_handler(const livox_ros_driver::CustomMsg::ConstPtr &msg);
   void oust64_handler(const sensor_msgs::PointCloud2::ConstPtr &msg);
   void velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg);
-  void give_feature(PointCloudXYZI &pl, vector<orgtype> &types);
+  void time_sort(const PointCloudXYZI &pl, PointCloudXYZI &out);
+  void record_time(double t);
+  bool resolve_layout(const sensor_msgs::PointCloud2 &msg);
+  void extract_lines(bool sqrt_range, uint min_line_size);
+  void give_feature(PointCloudXYZI &pl, vector<orgtype> &types, PointCloudXYZI &surf, PointCloudXYZI &corn);
   void pub_func(PointCloudXYZI &pl, const ros::Time &ct);
   int  plane_judge(const PointCloudXYZI &pl, vector<orgtype> &types, uint i, uint &i_nex, Eigen::Vector3d &curr_direct);
   bool small_plane(const PointCloudXYZI &pl, vector<orgtype> &types, uint i_cur, uint &i_nex, Eigen::Vector3d &curr_direct);
@@ -116,5 +189,4 @@ class Preprocess
   double cos160;
   double edgea, edgeb;
   double smallp_intersect, smallp_ratio;
-  double vx, vy, vz;
 };
\ No newline at end of file
@@ -0,0 +1,53 @@
+#ifndef SCAN_INGEST_H
+#define SCAN_INGEST_H
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <sensor_msgs/PointCloud2.h>
+#include <livox_ros_driver/CustomMsg.h>
+#include <common_lib.h>
+
+class Preprocess;
+
+/// *************Preprocess stage of the scan pipeline, running beside the estimator
+//; ROS回调只把原始消息放进有界队列，后台线程做解码、滤波和按时间排序，再通过deliver交给lidar_buffer
+//; 主线程的spinOnce不再被预处理阻塞，第k+1帧的预处理和第k帧的估计重叠；队列满时丢掉最旧的一帧并计数，回调从不等待
+class ScanIngest
+{
+public:
+    typedef std::function<void(double, PointCloudXYZI::Ptr)> Deliver;  //; 参数: 扫描时间戳，预处理后的点云
+
+    ScanIngest();
+    ~ScanIngest();
+
+    void init(const shared_ptr<Preprocess> &pre_param, int capacity_param, const Deliver &deliver_param);
+    void push(const livox_ros_driver::CustomMsg::ConstPtr &msg);
+    void push(const sensor_msgs::PointCloud2::ConstPtr &msg);
+
+    std::atomic<long> scan_num; //; 处理的扫描数，线程里更新
+    long drop_num;              //; 队列满丢掉的扫描数，在回调(spinOnce所在的主线程)里更新
+
+private:
+    struct RawScan
+    {
+        double stamp;
+        livox_ros_driver::CustomMsg::ConstPtr livox;
+        sensor_msgs::PointCloud2::ConstPtr cloud;
+    };
+
+    void enqueue(const RawScan &scan);
+    void run();
+
+    shared_ptr<Preprocess> pre;
+    Deliver deliver;
+    int capacity;
+    bool running;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable sig;
+    std::deque<RawScan> scans;
+};
+#endif
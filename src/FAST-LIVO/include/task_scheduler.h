@@ -0,0 +1,88 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+//; 任务优先级，空闲线程总是先取高优先级的任务
+enum TASK_PRIORITY
+{
+    TASK_CRITICAL = 0, //; 估计器关键路径: 去畸变、LIO/VIO下采样、同步预处理
+    TASK_MAP = 1,      //; 地图维护和流水线里的后台阶段(后台线程预处理)
+    TASK_VISUAL = 2,   //; 可视化
+    TASK_PRIORITY_NUM = 3
+};
+
+/// *************Work-stealing thread pool shared by preprocessing, LIO and VIO
+//; 所有并行循环都跑在同一组线程上，线程数和绑核在运行时配置，不同模块的并行段不会各自开线程互相抢核
+//; parallel_for把区间切块，轮流放到各个线程的队列里；线程先做自己队列的，做完去别的线程队列尾部偷；
+//; 调用线程只帮自己这个循环做，不会被别的模块的任务拖住，所以不同线程(主线程、预处理线程)可以同时提交
+//; submit的单个任务(ikd-Tree子树重建)必须在工作线程上做；IMU递推、扫描接收、地图插入、tile读写仍是常驻线程:
+//; 它们要按到达顺序处理、大部分时间阻塞在条件变量或磁盘IO上，thread_num = 1没有工作线程时也必须在后台运行
+class TaskScheduler
+{
+public:
+    typedef std::function<void(int, int)> RangeBody; //; 参数: [beg, end)
+
+    TaskScheduler();
+    ~TaskScheduler();
+
+    void init(int thread_num_param, const std::vector<int> &cores); //; thread_num包括调用线程，cores为空不绑核
+    int thread_num() const { return workers.size() + 1; }
+    //; 阻塞到整个区间做完；grain是每块的最少元素数
+    void parallel_for(int begin, int end, const RangeBody &body, int priority = TASK_CRITICAL, int grain = 1);
+    //; 不等待的单个任务，由工作线程执行；没有工作线程时返回false，调用方自己处理
+    bool submit(const std::function<void()> &func, int priority = TASK_MAP);
+
+    std::atomic<long> job_num, task_num, steal_num; //; 并行循环数、执行的块数、偷到的块数
+
+private:
+    struct Job
+    {
+        const RangeBody *body;
+        RangeBody own;  //; submit的任务自己持有函数
+        bool detached;  //; submit的任务没有人等，做完直接释放
+        std::atomic<int> remaining;
+        std::mutex m;
+        std::condition_variable done;
+    };
+    struct Task
+    {
+        Job *job;
+        int beg, end;
+    };
+    struct Queue
+    {
+        std::mutex m;
+        std::deque<Task> tasks[TASK_PRIORITY_NUM];
+    };
+
+    bool pop(int self, Task &task);          //; 工作线程: 按优先级先取自己队列头部，再偷别人队列尾部
+    bool pop_job(const Job *job, Task &task); //; 调用线程: 只取自己这个循环的块
+    void execute(const Task &task);
+    void run(int id);
+
+    bool running;
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::atomic<int> pending;    //; 队列里还没被取走的块数
+    std::atomic<unsigned> next;  //; 下一个循环从哪个队列开始放
+    std::mutex mtx;
+    std::condition_variable sig;
+};
+
+//; scheduler为空时串行执行，模块没有配置线程池也能用
+inline void parallel_for(TaskScheduler *scheduler, int begin, int end, const TaskScheduler::RangeBody &body,
+                         int priority = TASK_CRITICAL, int grain = 1)
+{
+    if (scheduler != nullptr)
+        scheduler->parallel_for(begin, end, body, priority, grain);
+    else if (begin < end)
+        body(begin, end);
+}
+#endif
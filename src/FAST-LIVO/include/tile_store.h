@@ -0,0 +1,62 @@
+#ifndef TILE_STORE_H
+#define TILE_STORE_H
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <unordered_map>
+#include <unordered_set>
+#include <common_lib.h>
+#include <ikd-Tree/ikd_Tree.h>
+
+/// *************Out-of-core LiDAR map tiles streamed by a background thread
+//; 局部地图裁剪掉的点按tile写到磁盘，车回来的时候再把和当前/预测的局部地图cube相交的tile读回来
+//; 所有磁盘读写都在后台线程，主线程只往队列里放任务、取结果，不会阻塞
+//; 每次运行写到dir下自己新建的子目录，退出时只删自己写的文件
+class TileStore
+{
+public:
+    TileStore();
+    ~TileStore();
+
+    void init(const string &dir_param, double tile_size_param);
+    void Store(const PointVector &points);  //; 把地图删掉的点交给后台线程写盘
+    void Prefetch(const BoxPointType &cube, const V3D &shift);  //; 请求和cube或平移shift之后的cube相交的tile
+    bool Fetch(const BoxPointType &cube, PointVector &points);  //; 取走已经读回来、落在cube里的点
+    int tile_num();  //; 磁盘上的tile数量
+    void Collect(PointVector &points);  //; 退出前停掉后台线程，取出磁盘上和读回来还没加回地图的所有点
+
+    long stored_num, loaded_num;  //; 写盘和读回的点数
+
+private:
+    struct TileTask
+    {
+        bool load;           //; true: 读tile，false: 写点
+        VOXEL_KEY key;       //; 读的tile
+        PointVector points;  //; 写的点
+    };
+
+    VOXEL_KEY key_of(float x, float y, float z) const;
+    string tile_file(const VOXEL_KEY &key) const;
+    bool tile_in_region(const VOXEL_KEY &key) const;  //; tile和hold_cube或hold_cube平移hold_shift相交
+    void write_points(PointVector &points);
+    bool read_tile(const string &file, PointVector &points);
+    void load_tile(const VOXEL_KEY &key);
+    void run();
+    void stop();  //; 等后台线程做完队列里的任务再退出
+
+    string dir;          //; 本次运行的子目录
+    double tile_size;
+    bool running;
+    std::thread worker;
+    std::mutex mtx;
+    std::condition_variable sig;
+    std::deque<TileTask> tasks;
+    unordered_set<VOXEL_KEY> on_disk;  //; 已经写到磁盘的tile
+    unordered_set<VOXEL_KEY> loading;  //; 已经请求读取还没读完的tile
+    PointVector loaded;  //; 读回来还没加回地图的点，tile不在预取范围里的会重新写盘
+    BoxPointType hold_cube;
+    V3D hold_shift;
+    bool hold_valid;
+};
+#endif
@@ -0,0 +1,56 @@
+#ifndef VOXEL_DOWNSAMPLE_H
+#define VOXEL_DOWNSAMPLE_H
+#include <unordered_map>
+#include <common_lib.h>
+#include "task_scheduler.h"
+
+//; 每个体素保留的点: 体素内所有点的均值(和pcl::VoxelGrid一样) 或 离体素中心最近的原始点
+enum VOXEL_SELECT_MODE
+{
+    VOXEL_CENTROID = 0,
+    VOXEL_NEAREST = 1
+};
+
+/// *************Hash based voxel downsampler, drop-in replacement for pcl::VoxelGrid<PointType>
+//; 一遍哈希归并，不排序，O(n)；按体素哈希值把点分给各个线程，每个线程只处理自己的体素，不需要加锁
+class VoxelDownsample
+{
+public:
+    VoxelDownsample();
+
+    void setLeafSize(float lx, float ly, float lz);
+    void setInputCloud(const PointCloudXYZI::ConstPtr &cloud) { input = cloud; }
+    void set_select_mode(int mode) { select_mode = mode; }
+    void set_thread_num(int num) { thread_num = num > 0 ? num : 1; }
+    void set_scheduler(TaskScheduler *scheduler_param); //; 按线程池的线程数分区，并行段跑在线程池上
+    void filter(PointCloudXYZI &output); //; output可以重复使用，不会每次重新分配
+
+private:
+    struct VoxelAccum
+    {
+        int n;
+        int best;       //; VOXEL_NEAREST: 离中心最近的点的下标
+        float best_dist;
+        float sum[8];   //; VOXEL_CENTROID: x y z intensity normal_x normal_y normal_z curvature 的和
+    };
+    //; 每个线程自己的哈希表和体素，clear之后保留容量
+    struct Partition
+    {
+        unordered_map<VOXEL_KEY, int> index;
+        vector<VoxelAccum> voxels;
+    };
+
+    void reduce(Partition &part, int beg, int end);
+
+    PointCloudXYZI::ConstPtr input;
+    float leaf[3], inv_leaf[3];
+    int select_mode;
+    int thread_num;
+    TaskScheduler *scheduler;
+    vector<VOXEL_KEY> keys;
+    vector<int> owner;  //; 每个点属于哪个线程，-1表示无效点
+    vector<int> order;  //; 按线程分桶后的点下标，桶内保持原始顺序
+    vector<int> bucket; //; 第t个线程的点在order里是[bucket[t], bucket[t+1])
+    vector<Partition> partitions;
+};
+#endif
@@ -9,6 +9,9 @@ ImuProcess::ImuProcess()
     : b_first_frame_(true), imu_need_init_(true), start_timestamp_(-1)
 {
     init_iter_num = 1;
+    undistort_mode = UNDISTORT_APPROX;
+    scheduler = nullptr;
+    undistort_time = 0;
 #ifdef USE_IKFOM
     Q = process_noise_cov();
 #endif
@@ -339,8 +342,7 @@ void ImuProcess::UndistortPcl(const MeasureGroup &meas, esekfom::esekf<state_ikf
 void ImuProcess::Forward(const MeasureGroup &meas, StatesGroup &state_inout, double pcl_beg_time, double end_time)
 {
     /*** add the imu of the last frame-tail to the of current frame-head ***/
-    auto v_imu = meas.imu;//从数据包中获取IMU数据
-    v_imu.push_front(last_imu_);
+    ImuSpan v_imu(last_imu_, meas.imu);//从数据包中获取IMU数据，上一帧最后一个IMU放在最前面
     const double &imu_beg_time = v_imu.front()->header.stamp.toSec();
     const double &imu_end_time = v_imu.back()->header.stamp.toSec();
 
@@ -358,14 +360,12 @@ void ImuProcess::Forward(const MeasureGroup &meas, StatesGroup &state_inout, dou
     V3D acc_imu = acc_s_last, angvel_avr = angvel_last, acc_avr, vel_imu(state_inout.vel_end), pos_imu(state_inout.pos_end);
     M3D R_imu(state_inout.rot_end);
     //  last_state = state_inout;
-    MD(DIM_STATE, DIM_STATE)
-    F_x, cov_w;
 
     double dt = 0;
-    for (auto it_imu = v_imu.begin(); it_imu < (v_imu.end() - 1); it_imu++)
+    for (int k = 0; k < v_imu.size() - 1; k++)
     {
-        auto &&head = *(it_imu);
-        auto &&tail = *(it_imu + 1);
+        auto &&head = v_imu[k];
+        auto &&tail = v_imu[k + 1];
 
         if (tail->header.stamp.toSec() < last_lidar_end_time_)
             continue;
@@ -399,27 +399,8 @@ void ImuProcess::Forward(const MeasureGroup &meas, StatesGroup &state_inout, dou
         }
         // cout<<setw(20)<<"dt: "<<dt<<endl;
         /* covariance propagation */
-        M3D acc_avr_skew;//计算角速度的斜对称矩阵(反对称矩阵)
+        propagate_cov(state_inout.cov, R_imu, acc_avr, angvel_avr, dt, cov_gyr, cov_acc, cov_bias_gyr, cov_bias_acc);
         M3D Exp_f = Exp(angvel_avr, dt);
-        acc_avr_skew << SKEW_SYM_MATRX(acc_avr);
-
-        F_x.setIdentity();
-        cov_w.setZero();
-
-        F_x.block<3, 3>(0, 0) = Exp(angvel_avr, -dt);
-        F_x.block<3, 3>(0, 9) = -Eye3d * dt;
-        // F_x.block<3,3>(3,0)  = R_imu * off_vel_skew * dt;
-        F_x.block<3, 3>(3, 6) = Eye3d * dt;
-        F_x.block<3, 3>(6, 0) = -R_imu * acc_avr_skew * dt;
-        F_x.block<3, 3>(6, 12) = -R_imu * dt;
-        F_x.block<3, 3>(6, 15) = Eye3d * dt;
-
-        cov_w.block<3, 3>(0, 0).diagonal() = cov_gyr * dt * dt;
-        cov_w.block<3, 3>(6, 6) = R_imu * cov_acc.asDiagonal() * R_imu.transpose() * dt * dt;
-        cov_w.block<3, 3>(9, 9).diagonal() = cov_bias_gyr * dt * dt;   // bias gyro covariance
-        cov_w.block<3, 3>(12, 12).diagonal() = cov_bias_acc * dt * dt; // bias acc covariance
-
-        state_inout.cov = F_x * state_inout.cov * F_x.transpose() + cov_w;
 
         /* propogation of IMU attitude 这个R_imu相当于把世界坐标系转到车体坐标系下*/
         R_imu = R_imu * Exp_f;
@@ -462,45 +443,140 @@ void ImuProcess::Forward(const MeasureGroup &meas, StatesGroup &state_inout, dou
 // 反向传播模型，用于修正激光点的运动畸变
 void ImuProcess::Backward(const LidarMeasureGroup &lidar_meas, StatesGroup &state_inout, PointCloudXYZI &pcl_out)
 {
-    /*** undistort each lidar point (backward propagation) ***/
-    M3D R_imu;
-    V3D acc_imu, angvel_avr, vel_imu, pos_imu;
-    double dt;
-    auto pos_liD_e = state_inout.pos_end + state_inout.rot_end * Lid_offset_to_IMU;
-    auto it_pcl = pcl_out.points.end() - 1;
-    for (auto it_kp = IMUpose.end() - 1; it_kp != IMUpose.begin(); it_kp--)//从后往前遍历IMU数据
-    {
-        auto head = it_kp - 1;
-        auto tail = it_kp;
-        R_imu << MAT_FROM_ARRAY(head->rot);
-        acc_imu << VEC_FROM_ARRAY(head->acc);
-        // cout<<"head imu acc: "<<acc_imu.transpose()<<endl;
-        vel_imu << VEC_FROM_ARRAY(head->vel);
-        pos_imu << VEC_FROM_ARRAY(head->pos);
-        angvel_avr << VEC_FROM_ARRAY(head->gyr);
-        for (; it_pcl->curvature / double(1000) > head->offset_time; it_pcl--)//从后往前遍历激光点,遍历到当前IMU数据的时间为止
-        {
-            dt = it_pcl->curvature / double(1000) - head->offset_time;
-
-            /* Transform to the 'end' frame, using only the rotation
-             * Note: Compensation direction is INVERSE of Frame's moving direction
-             * So if we want to compensate a point at timestamp-i to the frame-e
-             * P_compensate = R_imu_e ^ T * (R_i * P_i + T_ei) where T_ei is represented in global frame */
-            M3D R_i(R_imu * Exp(angvel_avr, dt));//拿到这一时刻下的imu旋转矩阵
-            V3D T_ei(pos_imu + vel_imu * dt + 0.5 * acc_imu * dt * dt + R_i * Lid_offset_to_IMU - pos_liD_e);
+    undistort_points(state_inout, pcl_out);
+}
 
-            V3D P_i(it_pcl->x, it_pcl->y, it_pcl->z);
-            V3D P_compensate = state_inout.rot_end.transpose() * (R_i * P_i + T_ei);//对于过去的某个激光点，先转到对应的过去imu坐标系下，然后再转到当前imu坐标系下
+/**
+ * @brief 反向传播去畸变：把每个点变换到帧尾时刻的IMU坐标系下
+ *        按IMUpose把点分成段，段内的变换系数只算一次，然后把每段按UNDISTORT_CHUNK切成任务并行处理
+ *        UNDISTORT_APPROX下每个任务把点转成SoA的float数组，旋转用二阶展开，做SIMD计算
+ *
+ * @param state  帧尾的状态
+ * @param pcl_out  按时间排好序的点云，原地去畸变
+ */
+void ImuProcess::undistort_points(const StatesGroup &state, PointCloudXYZI &pcl_out)
+{
+    double t0 = omp_get_wtime();
+    undist_segs.clear();
+    undist_tasks.clear();
+    const int size = pcl_out.points.size();
+    if (size == 0 || IMUpose.size() < 2)
+    {
+        undistort_time = 0;
+        return;
+    }
 
-            /// save Undistorted points and their rotation
-            it_pcl->x = P_compensate(0);
-            it_pcl->y = P_compensate(1);
-            it_pcl->z = P_compensate(2);
+    /*** 从后往前给每段IMU分点，和原来的串行循环一样，时间早于IMUpose.front()的点不处理 ***/
+    const M3D R_end_T = state.rot_end.transpose();
+    const V3D pos_liD_e = state.pos_end + state.rot_end * Lid_offset_to_IMU;
+    int end = size;
+    for (int k = IMUpose.size() - 1; k > 0 && end > 0; k--)
+    {
+        const Pose6D &head = IMUpose[k - 1];
+        int beg = end;
+        while (beg > 0 && pcl_out.points[beg - 1].curvature / double(1000) > head.offset_time)
+            beg--;
+        if (beg == end)
+            continue;
 
-            if (it_pcl == pcl_out.points.begin())
-                break;
+        UndistortSegment seg;
+        M3D R_imu;
+        V3D pos_imu;
+        R_imu << MAT_FROM_ARRAY(head.rot);
+        pos_imu << VEC_FROM_ARRAY(head.pos);
+        seg.head = k - 1;
+        seg.A = R_end_T * R_imu;
+        seg.b = R_end_T * (pos_imu - pos_liD_e);
+        seg.vel << VEC_FROM_ARRAY(head.vel);
+        seg.vel = R_end_T * seg.vel;
+        seg.acc << VEC_FROM_ARRAY(head.acc);
+        seg.acc = R_end_T * seg.acc;
+        seg.gyr << VEC_FROM_ARRAY(head.gyr);
+        for (int i = beg; i < end; i += UNDISTORT_CHUNK)
+        {
+            UndistortTask task;
+            task.seg = undist_segs.size();
+            task.beg = i;
+            task.end = min(i + UNDISTORT_CHUNK, end);
+            undist_tasks.push_back(task);
         }
+        undist_segs.push_back(seg);
+        end = beg;
     }
+
+    /* Transform to the 'end' frame
+     * P_compensate = R_imu_e ^ T * (R_i * P_i + T_ei) where T_ei is represented in global frame
+     *              = A * Exp(w * dt) * (P_i + L) + b + vel * dt + 0.5 * acc * dt * dt */
+    const int task_num = undist_tasks.size();
+    parallel_for(scheduler, 0, task_num, [&](int task_beg, int task_end) {
+        for (int k = task_beg; k < task_end; k++)
+        {
+            const UndistortTask &task = undist_tasks[k];
+            const UndistortSegment &seg = undist_segs[task.seg];
+            const double head_time = IMUpose[seg.head].offset_time;
+            PointType *pts = pcl_out.points.data() + task.beg;
+            const int num = task.end - task.beg;
+
+            if (undistort_mode == UNDISTORT_EXACT)
+            {
+                for (int j = 0; j < num; j++)
+                {
+                    double dt = pts[j].curvature / double(1000) - head_time;
+                    V3D P_i(pts[j].x, pts[j].y, pts[j].z);
+                    V3D P_compensate = seg.A * (Exp(seg.gyr, dt) * (P_i + Lid_offset_to_IMU)) + seg.b + seg.vel * dt + 0.5 * seg.acc * dt * dt;
+                    pts[j].x = P_compensate(0);
+                    pts[j].y = P_compensate(1);
+                    pts[j].z = P_compensate(2);
+                }
+                continue;
+            }
+
+            //; 段内的系数都转成float，点转成SoA
+            float A[9], b[3], v[3], a[3], w[3], L[3];
+            for (int r = 0; r < 3; r++)
+            {
+                for (int c = 0; c < 3; c++)
+                    A[r * 3 + c] = seg.A(r, c);
+                b[r] = seg.b(r);
+                v[r] = seg.vel(r);
+                a[r] = seg.acc(r);
+                w[r] = seg.gyr(r);
+                L[r] = Lid_offset_to_IMU(r);
+            }
+            float x[UNDISTORT_CHUNK], y[UNDISTORT_CHUNK], z[UNDISTORT_CHUNK], h[UNDISTORT_CHUNK];
+            for (int j = 0; j < num; j++)
+            {
+                x[j] = pts[j].x + L[0];
+                y[j] = pts[j].y + L[1];
+                z[j] = pts[j].z + L[2];
+                h[j] = pts[j].curvature / double(1000) - head_time;
+            }
+    #ifdef MP_EN
+            #pragma omp simd
+    #endif
+            for (int j = 0; j < num; j++)
+            {
+                //; Exp(w * dt) * q ~= q + dt * (w x q) + dt^2 / 2 * (w x (w x q))
+                float cx = w[1] * z[j] - w[2] * y[j];
+                float cy = w[2] * x[j] - w[0] * z[j];
+                float cz = w[0] * y[j] - w[1] * x[j];
+                float hh = 0.5f * h[j] * h[j];
+                float qx = x[j] + h[j] * cx + hh * (w[1] * cz - w[2] * cy);
+                float qy = y[j] + h[j] * cy + hh * (w[2] * cx - w[0] * cz);
+                float qz = z[j] + h[j] * cz + hh * (w[0] * cy - w[1] * cx);
+                x[j] = A[0] * qx + A[1] * qy + A[2] * qz + b[0] + v[0] * h[j] + a[0] * hh;
+                y[j] = A[3] * qx + A[4] * qy + A[5] * qz + b[1] + v[1] * h[j] + a[1] * hh;
+                z[j] = A[6] * qx + A[7] * qy + A[8] * qz + b[2] + v[2] * h[j] + a[2] * hh;
+            }
+            for (int j = 0; j < num; j++)
+            {
+                pts[j].x = x[j];
+                pts[j].y = y[j];
+                pts[j].z = z[j];
+            }
+        }
+    });
+    undistort_time = omp_get_wtime() - t0;
 }
 
 #endif
@@ -574,7 +650,7 @@ void ImuProcess::Process(const LidarMeasureGroup &lidar_meas, StatesGroup &stat,
     double t1, t2, t3;
     t1 = omp_get_wtime();
     ROS_ASSERT(lidar_meas.lidar != nullptr);
-    MeasureGroup meas = lidar_meas.measures.back();
+    const MeasureGroup &meas = lidar_meas.measures.back();
 
     if (imu_need_init_)
     {
@@ -619,7 +695,8 @@ void ImuProcess::Process(const LidarMeasureGroup &lidar_meas, StatesGroup &stat,
     {
         /*** sort point clouds by offset time ***/
         *cur_pcl_un_ = *(lidar_meas.lidar);
-        sort(cur_pcl_un_->points.begin(), cur_pcl_un_->points.end(), time_list);
+        if (!is_sorted(cur_pcl_un_->points.begin(), cur_pcl_un_->points.end(), time_list))
+            sort(cur_pcl_un_->points.begin(), cur_pcl_un_->points.end(), time_list);
         const double &pcl_beg_time = lidar_meas.lidar_beg_time;
         const double &pcl_end_time = pcl_beg_time + lidar_meas.lidar->points.back().curvature / double(1000);
         Forward(meas, stat, pcl_beg_time, pcl_end_time);
@@ -661,11 +738,10 @@ void ImuProcess::Process(const LidarMeasureGroup &lidar_meas, StatesGroup &stat,
 void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_inout, PointCloudXYZI &pcl_out)
 {
     /*** add the imu of the last frame-tail to the of current frame-head ***/
-    MeasureGroup meas;
-    meas = lidar_meas.measures.back();  //; measures里面可能有多帧图像，这里处理的就是最新帧的图像
+    const MeasureGroup &meas = lidar_meas.measures.back();  //; measures里面可能有多帧图像，这里处理的就是最新帧的图像
     // cout<<"meas.imu.size: "<<meas.imu.size()<<endl;
-    auto v_imu = meas.imu;   //; 把这帧图像对应的IMU数据拿出来就行了，因为之前的图像的IMU数据已经被处理过了
-    v_imu.push_front(last_imu_); // 将上一帧最后尾部的imu添加到当前帧头部的imu
+    //; 把这帧图像对应的IMU数据拿出来就行了，因为之前的图像的IMU数据已经被处理过了
+    ImuSpan v_imu(last_imu_, meas.imu); // 将上一帧最后尾部的imu添加到当前帧头部的imu
     const double &imu_beg_time = v_imu.front()->header.stamp.toSec();
     const double &imu_end_time = v_imu.back()->header.stamp.toSec();
 
@@ -674,7 +750,6 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
     // const double &pcl_beg_time = meas.lidar_beg_time;
 
     /*** sort point clouds by offset time ***/
-    pcl_out.clear();
     auto pcl_it = lidar_meas.lidar->points.begin() + lidar_meas.lidar_scan_index_now;
     auto pcl_it_end = lidar_meas.lidar->points.end();
     //; 点云结束的时间戳：图像时间戳 或者 lidar的scan结束点的时间戳（是绝对时间戳），也是
@@ -683,12 +758,13 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
                     (pcl_end_time - lidar_meas.lidar_beg_time) * double(1000) : 0.0;
     //! 疑问：bug？如果这个不是lidar点云结束，那么 pcl_offset_time == 0，那下面一个点云都不会加进去？
     //; 解答：确实是这样，以为要去畸变到lidar末尾时间戳，而如果当前是图像时间，那么这帧图像后面的IMU数据是缺失的
-    while (pcl_it != pcl_it_end && pcl_it->curvature <= pcl_offset_time)
-    {
-        pcl_out.push_back(*pcl_it);
-        pcl_it++;
-        lidar_meas.lidar_scan_index_now++;  //; 这个循环一直进不来，所以这个变量应该一直是0
-    }
+    //; 点已经按时间排好序，二分找到结束位置，一次性拷到pcl_out里(pcl_out的容量每帧复用)
+    auto pcl_it_stop = upper_bound(pcl_it, pcl_it_end, pcl_offset_time,
+                                   [](double t, const PointType &p) { return t < p.curvature; });
+    pcl_out.points.assign(pcl_it, pcl_it_stop);
+    pcl_out.width = pcl_out.points.size();
+    pcl_out.height = 1;
+    lidar_meas.lidar_scan_index_now += pcl_it_stop - pcl_it;  //; 这个变量应该一直是0
     // cout<<"pcl_offset_time:  "<<pcl_offset_time<<"pcl_it->curvature:  "<<pcl_it->curvature<<endl;
     // cout<<"lidar_meas.lidar_scan_index_now:"<<lidar_meas.lidar_scan_index_now<<endl;
     //; 上次跟新的时间，说的应该就是IMU积分预测的状态的时间，可能是图像的时间戳，也可能是lidar点云的时间戳
@@ -715,13 +791,12 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
     /*** forward propagation at each imu point ***/
     V3D acc_imu(acc_s_last), angvel_avr(angvel_last), acc_avr, vel_imu(state_inout.vel_end), pos_imu(state_inout.pos_end);
     M3D R_imu(state_inout.rot_end);
-    MD(DIM_STATE, DIM_STATE) F_x, cov_w;
 
     double dt = 0;
-    for (auto it_imu = v_imu.begin(); it_imu != v_imu.end() - 1; it_imu++)
+    for (int k = 0; k < v_imu.size() - 1; k++)
     {
-        auto &&head = *(it_imu);
-        auto &&tail = *(it_imu + 1);
+        auto &&head = v_imu[k];
+        auto &&tail = v_imu[k + 1];
 
         //; last_lidar_end_time_ 是上一次处理的一帧数据的时间戳，也就是上一帧图像的时间或者lidar的时间
         if (tail->header.stamp.toSec() < last_lidar_end_time_)
@@ -757,27 +832,8 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
         }
 
         /* covariance propagation */
-        M3D acc_avr_skew;
+        propagate_cov(state_inout.cov, R_imu, acc_avr, angvel_avr, dt, cov_gyr, cov_acc, cov_bias_gyr, cov_bias_acc);
         M3D Exp_f = Exp(angvel_avr, dt);
-        acc_avr_skew << SKEW_SYM_MATRX(acc_avr);
-
-        F_x.setIdentity();
-        cov_w.setZero();
-
-        F_x.block<3, 3>(0, 0) = Exp(angvel_avr, -dt);
-        F_x.block<3, 3>(0, 9) = -Eye3d * dt;
-        // F_x.block<3,3>(3,0)  = R_imu * off_vel_skew * dt;
-        F_x.block<3, 3>(3, 6) = Eye3d * dt;
-        F_x.block<3, 3>(6, 0) = -R_imu * acc_avr_skew * dt;
-        F_x.block<3, 3>(6, 12) = -R_imu * dt;
-        F_x.block<3, 3>(6, 15) = Eye3d * dt;
-
-        cov_w.block<3, 3>(0, 0).diagonal() = cov_gyr * dt * dt;
-        cov_w.block<3, 3>(6, 6) = R_imu * cov_acc.asDiagonal() * R_imu.transpose() * dt * dt;
-        cov_w.block<3, 3>(9, 9).diagonal() = cov_bias_gyr * dt * dt;   // bias gyro covariance
-        cov_w.block<3, 3>(12, 12).diagonal() = cov_bias_acc * dt * dt; // bias acc covariance
-
-        state_inout.cov = F_x * state_inout.cov * F_x.transpose() + cov_w;
 
         /* propogation of IMU attitude */
         R_imu = R_imu * Exp_f;
@@ -826,11 +882,11 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
     last_imu_ = v_imu.back();
     last_lidar_end_time_ = pcl_end_time;
 
-    auto pos_liD_e = state_inout.pos_end + state_inout.rot_end * Lid_offset_to_IMU;
-    // auto R_liD_e   = state_inout.rot_end * Lidar_R_to_IMU;
-
     if (pcl_out.points.size() < 1)
+    {
+        undistort_time = 0;
         return;
+    }
 
     /*** undistort each lidar point (backward propagation) ***/
     //; 最后对这帧的LiDAR点云进行去畸变处理，注意这里是全部去畸变到这阵数据的时间戳上，比如一帧图像数据的时间戳上
@@ -838,43 +894,8 @@ void ImuProcess::UndistortPcl(LidarMeasureGroup &lidar_meas, StatesGroup &state_
     //! 疑问：还是前面那个问题，感觉这里如果是一帧图像的话，根本没有进行去畸变处理！不过这样是没有问题的，
     //!      因为如果当前是图像的话，对这帧LiDAR点云去畸变也用不上，因为图像用的是上一帧的LiDAR点云。
     //!  但是：前面对位姿进行了清空，这不就导致去畸变的时候有很多位姿是缺失的吗？
-    auto it_pcl = pcl_out.points.end() - 1;
-    for (auto it_kp = IMUpose.end() - 1; it_kp != IMUpose.begin(); it_kp--)
-    {
-        auto head = it_kp - 1;
-        auto tail = it_kp;
-        R_imu << MAT_FROM_ARRAY(head->rot);
-        acc_imu << VEC_FROM_ARRAY(head->acc);
-        // cout<<"head imu acc: "<<acc_imu.transpose()<<endl;
-        vel_imu << VEC_FROM_ARRAY(head->vel);
-        pos_imu << VEC_FROM_ARRAY(head->pos);
-        angvel_avr << VEC_FROM_ARRAY(head->gyr);
-
-        for (; it_pcl->curvature / double(1000) > head->offset_time; it_pcl--)
-        {
-            //! 疑问：感觉这里是有问题的，因为offset_time是以上一帧图像的时间戳为参考的，而
-            //! curvature是以一帧lidar点云的时间戳为参考的，明显是不对的！
-            dt = it_pcl->curvature / double(1000) - head->offset_time;
-
-            /* Transform to the 'end' frame, using only the rotation
-             * Note: Compensation direction is INVERSE of Frame's moving direction
-             * So if we want to compensate a point at timestamp-i to the frame-e
-             * P_compensate = R_imu_e ^ T * (R_i * P_i + T_ei) where T_ei is represented in global frame */
-            M3D R_i(R_imu * Exp(angvel_avr, dt));
-            V3D T_ei(pos_imu + vel_imu * dt + 0.5 * acc_imu * dt * dt + R_i * Lid_offset_to_IMU - pos_liD_e);
-
-            V3D P_i(it_pcl->x, it_pcl->y, it_pcl->z);
-            V3D P_compensate = state_inout.rot_end.transpose() * (R_i * P_i + T_ei);
-
-            /// save Undistorted points and their rotation
-            it_pcl->x = P_compensate(0);
-            it_pcl->y = P_compensate(1);
-            it_pcl->z = P_compensate(2);
-
-            if (it_pcl == pcl_out.points.begin())
-                break;
-        }
-    }
+    //! 疑问：offset_time是以上一帧图像的时间戳为参考的，而curvature是以一帧lidar点云的时间戳为参考的
+    undistort_points(state_inout, pcl_out);
 }
 
 void ImuProcess::Process2(LidarMeasureGroup &lidar_meas, StatesGroup &stat, PointCloudXYZI::Ptr cur_pcl_un_)
@@ -885,7 +906,7 @@ void ImuProcess::Process2(LidarMeasureGroup &lidar_meas, StatesGroup &stat, Poin
     //; 这里就是数据同步的时候自己说的，一帧LiDAR前面可能有多帧的图像，但是每次同步插入的都是最新帧的图像，
     //; 所以这里处理的时候也要拿出最新帧的图像数据来处理（如果没有图像的话，那么measures里面就相当于一帧
     //; 空的图像，然后附带了很多对齐的IMU，此时就相当于单独处理IMU，没有图像也不影响）
-    MeasureGroup meas = lidar_meas.measures.back(); // TODO:back??
+    const MeasureGroup &meas = lidar_meas.measures.back(); // TODO:back??
 
     if (imu_need_init_)
     {
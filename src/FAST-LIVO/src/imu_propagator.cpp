@@ -0,0 +1,163 @@
+#include "imu_propagator.h"
+
+#define IMU_HISTORY_MAX (4000) //; 长时间没有滤波器更新时，IMU缓存的上限
+
+ImuPropagator::ImuPropagator()
+{
+    running = false;
+    anchor_new = false;
+    anchored = false;
+    anchor_time = 0;
+    anchor_acc_scale = 1.0;
+    cur_time = 0;
+    acc_scale = 1.0;
+    published_num = 0;
+    aver_lag = 0;
+}
+
+ImuPropagator::~ImuPropagator()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    sig.notify_all();
+    worker.join();
+}
+
+void ImuPropagator::init(const ros::Publisher &pub_odom)
+{
+    pub = pub_odom;
+    running = true;
+    worker = std::thread(&ImuPropagator::run, this);
+}
+
+void ImuPropagator::push_imu(const sensor_msgs::Imu::ConstPtr &msg)
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        imu_new.push_back(msg);
+    }
+    sig.notify_one();
+}
+
+void ImuPropagator::set_anchor(const StatesGroup &state, double time, double acc_scale_param)
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        anchor.rot = state.rot_end;
+        anchor.pos = state.pos_end;
+        anchor.vel = state.vel_end;
+        anchor.bias_g = state.bias_g;
+        anchor.bias_a = state.bias_a;
+        anchor.gravity = state.gravity;
+        anchor_time = time;
+        anchor_acc_scale = acc_scale_param;
+        anchor_new = true;
+    }
+    sig.notify_one();
+}
+
+bool ImuPropagator::propagate(const sensor_msgs::Imu::ConstPtr &head, const sensor_msgs::Imu::ConstPtr &tail)
+{
+    double tail_time = tail->header.stamp.toSec();
+    if (tail_time <= cur_time)
+        return false;
+    double dt = tail_time - max(head->header.stamp.toSec(), cur_time);
+
+    //; 和UndistortPcl一样的中值积分
+    V3D angvel_avr(0.5 * (head->angular_velocity.x + tail->angular_velocity.x),
+                   0.5 * (head->angular_velocity.y + tail->angular_velocity.y),
+                   0.5 * (head->angular_velocity.z + tail->angular_velocity.z));
+    V3D acc_avr(0.5 * (head->linear_acceleration.x + tail->linear_acceleration.x),
+                0.5 * (head->linear_acceleration.y + tail->linear_acceleration.y),
+                0.5 * (head->linear_acceleration.z + tail->linear_acceleration.z));
+    angvel_avr -= cur.bias_g;
+    acc_avr = acc_avr * acc_scale - cur.bias_a;
+
+    cur.rot = cur.rot * Exp(angvel_avr, dt);
+    V3D acc_imu = cur.rot * acc_avr + cur.gravity;
+    cur.pos = cur.pos + cur.vel * dt + 0.5 * acc_imu * dt * dt;
+    cur.vel = cur.vel + acc_imu * dt;
+    cur_time = tail_time;
+    return true;
+}
+
+void ImuPropagator::publish(double stamp)
+{
+    nav_msgs::Odometry odom;
+    odom.header.frame_id = "camera_init";
+    odom.child_frame_id = "aft_mapped";
+    odom.header.stamp = ros::Time().fromSec(stamp);
+    Eigen::Quaterniond q(cur.rot);
+    odom.pose.pose.position.x = cur.pos(0);
+    odom.pose.pose.position.y = cur.pos(1);
+    odom.pose.pose.position.z = cur.pos(2);
+    odom.pose.pose.orientation.x = q.x();
+    odom.pose.pose.orientation.y = q.y();
+    odom.pose.pose.orientation.z = q.z();
+    odom.pose.pose.orientation.w = q.w();
+    odom.twist.twist.linear.x = cur.vel(0);
+    odom.twist.twist.linear.y = cur.vel(1);
+    odom.twist.twist.linear.z = cur.vel(2);
+    pub.publish(odom);
+
+    long num = ++published_num;
+    aver_lag = aver_lag * (num - 1) / num + (ros::Time::now().toSec() - stamp) / num;
+}
+
+void ImuPropagator::run()
+{
+    while (true)
+    {
+        deque<sensor_msgs::Imu::ConstPtr> imus;
+        bool reanchor = false;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            sig.wait(lock, [this] { return !running || anchor_new || !imu_new.empty(); });
+            if (!running)
+                return;
+            imus.swap(imu_new);
+            if (anchor_new)
+            {
+                cur = anchor;
+                cur_time = anchor_time;
+                acc_scale = anchor_acc_scale;
+                anchor_new = false;
+                reanchor = true;
+            }
+        }
+
+        if (reanchor)
+        {
+            //; 从新的状态开始，用缓存的IMU重新积分到当前时刻；anchor之前的IMU只留最后一个做中值积分的head
+            anchored = true;
+            while (imu_history.size() > 1 && imu_history[1]->header.stamp.toSec() <= cur_time)
+                imu_history.pop_front();
+            for (int k = 1; k < imu_history.size(); k++)
+                propagate(imu_history[k - 1], imu_history[k]);
+        }
+
+        for (int k = 0; k < imus.size(); k++)
+        {
+            if (!imu_history.empty() && imus[k]->header.stamp.toSec() < imu_history.back()->header.stamp.toSec())
+            {
+                imu_history.clear(); //; imu loop back，等下一次滤波器更新重新锚定
+                anchored = false;
+            }
+            imu_history.push_back(imus[k]);
+            if (imu_history.size() > IMU_HISTORY_MAX)
+                imu_history.pop_front();
+            if (!anchored || imu_history.size() < 2)
+                continue;
+            if (propagate(imu_history[imu_history.size() - 2], imu_history.back()))
+                publish(cur_time);
+        }
+    }
+}
@@ -65,13 +65,22 @@
 #include <opencv2/opencv.hpp>
 #include <vikit/camera_loader.h>
 #include "lidar_selection.h"
+#include "plane_cache.h"
+#include "voxel_downsample.h"
+#include "tile_store.h"
+#include "imu_propagator.h"
+#include "point_budget.h"
+#include "scan_ingest.h"
+#include "map_inserter.h"
+#include "task_scheduler.h"
 
 #ifdef USE_ikdtree
 #ifdef USE_ikdforest
 #include <ikd-Forest/ikd_Forest.h>
 #else
 
-#include <ikd-Tree/ikd_Tree.h>
+#include "lidar_map.h"
+#include <FOV_Checker/FOV_Checker.h>
 
 #endif
 #else
@@ -138,6 +147,30 @@ int lidar_en = 1;       // 是否使用激光雷达
 int debug = 0;          // 是否开启debug模式
 bool fast_lio_is_ready = false;
 int grid_size, patch_size;  //; 网格大小，patch大小
+int map_backend = MAP_IKDTREE, ivox_nearby_type = NEARBY18;   //; 地图后端类型，iVox近邻体素类型
+double ivox_grid_resolution = 0.5;  //; iVox体素大小
+bool plane_cache_en = false;    //; 是否使用体素平面缓存代替近邻搜索+平面拟合
+int plane_cache_min_points = 10;
+double plane_cache_voxel_size = 1.0, plane_cache_thickness = 0.03;
+PlaneCache plane_cache;  //; 体素平面缓存
+double neighbour_reuse_ratio = 0.1;  //; 重新匹配时，点的位移小于近邻半径的这个比例就复用上一次的近邻，0表示不复用
+long neighbour_query_num = 0, neighbour_reuse_num = 0;  //; 需要近邻的次数和复用的次数
+int downsample_mode = VOXEL_CENTROID;  //; 体素降采样保留的点: 0 体素均值, 1 离体素中心最近的点
+int undistort_mode = UNDISTORT_APPROX; //; 去畸变的旋转: 0 逐点Exp, 1 二阶展开(SIMD)
+double downsample_time = 0;  //; 当前帧扫描降采样的时间
+bool point_budget_en = false;  //; 按LIO耗时上限自适应调下采样分辨率和点数
+double lio_deadline = 50.0, budget_leaf_max = 2.0;  //; 每帧LIO(下采样到滤波结束)的耗时上限(ms)，分辨率上限
+PointBudget point_budget;
+string prior_map_file, map_save_file;  //; 启动时加载的先验地图快照，退出时保存的地图快照，空表示不用
+bool map_save_attributes = true;  //; 快照里是否保存强度、法向量等属性
+bool fov_segment_en = false;  //; 前向雷达(Avia/Mid-70)只保留和FOV锥体相交的地图盒子
+double fov_box_length = 10.0, fov_margin_deg = 10.0, fov_depth = 100.0;  //; 盒子边长，FOV半角的余量，锥体深度
+bool tile_store_en = false;  //; 局部地图裁剪掉的点写到磁盘tile，回来的时候再读回来
+string tile_dir;
+double tile_size = 50.0, tile_prefetch_time = 3.0;  //; tile边长，按速度预测cube位置的时间
+TileStore tile_store;
+bool imu_odom_en = false;  //; 后台线程按IMU频率外推并发布位姿
+ImuPropagator imu_propagator;
 double outlier_threshold, ncc_thre; //; outlier异常值阈值，ncc阈值
 
 vector<BoxPointType> cub_needrm;    //; 需要删除的立方体
@@ -151,7 +184,19 @@ deque<double> img_time_buffer;  // 图像时间戳
 vector<bool> point_selected_surf;   //; 选中的点云
 vector<vector<int>> pointSearchInd_surf;    //; 搜索到的点云
 vector<PointVector> Nearest_Points;   //; 最近的点云
+vector<V3F> search_center;  //; 上一次近邻搜索时点的世界坐标
+vector<float> search_sq_dis;  //; 上一次近邻搜索最远近邻的距离平方，<0表示无效
 vector<double> res_last;
+bool lio_float_en = false;  //; true时LIO的点投影和雅可比走float的SoA路径，默认用原来的double计算
+vector<float> body_x, body_y, body_z, world_x, world_y, world_z;  //; 下采样点body系和world系坐标的SoA
+vector<float> H_soa[6], z_soa;  //; float雅可比的每一列和残差
+bool info_select_en = false;  //; 按对信息矩阵的贡献选出有限个点，这一帧后面的迭代只匹配这些点
+int info_select_num = 1000;   //; 选出的点数上限
+double degeneracy_thresh = 0.0;  //; H^T H最小特征值低于这个值认为退化，0表示不检测
+vector<int> effct_index;      //; 有效点对应的下采样点序号
+vector<bool> point_info_keep; //; 这一帧还参与匹配的下采样点
+VD(6) info_eigen = VD(6)::Zero();  //; 最近一次迭代H^T H的特征值(升序)
+long info_select_frames = 0, degenerate_frames = 0;
 vector<double> extrinT(3, 0.0); //; 外参
 vector<double> extrinR(9, 0.0);  //; 外参
 vector<double> cameraextrinT(3, 0.0);   //; 相机外参
@@ -172,14 +217,14 @@ PointCloudXYZI::Ptr normvec(new PointCloudXYZI());      //一种点云类型，
 PointCloudXYZI::Ptr laserCloudOri(new PointCloudXYZI());    //; 原始的激光点云
 PointCloudXYZI::Ptr corr_normvect(new PointCloudXYZI());    //; 点云的法向量
 
-pcl::VoxelGrid<PointType> downSizeFilterSurf;   //; 下采样滤波器surf表面
-pcl::VoxelGrid<PointType> downSizeFilterMap;        //; 下采样滤波器地图
+VoxelDownsample downSizeFilterSurf;   //; 下采样滤波器surf表面
+VoxelDownsample downSizeFilterMap;        //; 下采样滤波器地图
 
 #ifdef USE_ikdtree
 #ifdef USE_ikdforest
 KD_FOREST ikdforest;
 #else
-KD_TREE ikdtree;
+LidarMapPtr lidar_map;  //; 激光地图，ikd-Tree或者iVox
 #endif
 #else
 pcl::KdTreeFLANN<PointType>::Ptr kdtreeSurfFromMap(new pcl::KdTreeFLANN<PointType>());
@@ -210,6 +255,15 @@ geometry_msgs::PoseStamped msg_body_pose;
 
 //; 这个应该是lidar的前端特征点云的预处理类，主要是对lidar的点云进行稍微的处理（但是和提取平面特征又不完全一样）
 shared_ptr<Preprocess> p_pre(new Preprocess());
+bool ingest_thread_en = false;  //; 预处理放到后台线程，ROS回调只入队
+int ingest_queue_size = 4;      //; 待预处理扫描队列的上限
+ScanIngest scan_ingest;
+bool map_insert_async_en = false; //; 地图插入放到后台线程，发布里程计不等插入完成
+int map_insert_max_lag = 0;       //; 访问地图时允许还没插入的帧数，0表示每帧都能看到上一帧的点
+MapInserter map_inserter;
+int thread_num = MP_PROC_NUM;   //; 线程池的线程数(包括调用线程)
+vector<int> thread_cores;       //; 线程池工作线程绑定的核，空表示不绑
+TaskScheduler task_scheduler;   //; 预处理、去畸变、LIO/VIO下采样、可视化共用的线程池
 
 void SigHandle(int sig)//; 信号处理函数ROS下必须要用这个函数
 {
@@ -296,6 +350,164 @@ void pointBodyToWorld(const Matrix<T, 3, 1> &pi, Matrix<T, 3, 1> &po)
     po[2] = p_global(2);
 }
 
+//; 计算第i个下采样点到平面pabcd的残差，满足条件则保存法向量和残差，返回是否选中
+bool plane_residual(int i, const VF(4) & pabcd)
+{
+    const PointType &point_body = feats_down_body->points[i];
+    const PointType &point_world = feats_down_world->points[i];
+    V3D p_body(point_body.x, point_body.y, point_body.z);
+    float pd2 = pabcd(0) * point_world.x + pabcd(1) * point_world.y + pabcd(2) * point_world.z +
+                pabcd(3);//获得点到平面的距离
+    float s = 1 - 0.9 * fabs(pd2) / sqrt(p_body.norm()); // fabs(pd2) / sqrt(p_body.norm())
+    //s表示一个减小的权重因子。这个因子随着点到平面的距离增加而减小。点到平面的距离/点到此帧的距离的开方
+    if (s > 0.9)
+    { // TODO: threshold 点到平面距离 < 1/9，则保留点用于平面，保留平面法向量
+        normvec->points[i].x = pabcd(0); // hr: save normvec
+        normvec->points[i].y = pabcd(1);
+        normvec->points[i].z = pabcd(2);
+        normvec->points[i].intensity = pd2;
+        res_last[i] = abs(pd2); // hr: save residuals//保存残差
+        return true;
+    }
+    return false;
+}
+
+//; 下采样点拆成float的SoA，一帧的迭代中只有位姿在变
+void body_to_soa()
+{
+    body_x.resize(feats_down_size);
+    body_y.resize(feats_down_size);
+    body_z.resize(feats_down_size);
+    world_x.resize(feats_down_size);
+    world_y.resize(feats_down_size);
+    world_z.resize(feats_down_size);
+    for (int i = 0; i < feats_down_size; i++)
+    {
+        const PointType &p = feats_down_body->points[i];
+        body_x[i] = p.x;
+        body_y[i] = p.y;
+        body_z[i] = p.z;
+    }
+}
+
+//; float版本的pointBodyToWorld，外参合并进平移，旋转和平移每次迭代只转换一次
+void body_to_world_float()
+{
+    const M3F rot = state.rot_end.cast<float>();
+    const V3F pos = (state.rot_end * Lidar_offset_to_IMU + state.pos_end).cast<float>();
+    const float r00 = rot(0, 0), r01 = rot(0, 1), r02 = rot(0, 2);
+    const float r10 = rot(1, 0), r11 = rot(1, 1), r12 = rot(1, 2);
+    const float r20 = rot(2, 0), r21 = rot(2, 1), r22 = rot(2, 2);
+    const float t0 = pos(0), t1 = pos(1), t2 = pos(2);
+    const float *bx = body_x.data(), *by = body_y.data(), *bz = body_z.data();
+    float *wx = world_x.data(), *wy = world_y.data(), *wz = world_z.data();
+#ifdef MP_EN
+    #pragma omp simd
+#endif
+    for (int i = 0; i < feats_down_size; i++)
+    {
+        wx[i] = r00 * bx[i] + r01 * by[i] + r02 * bz[i] + t0;
+        wy[i] = r10 * bx[i] + r11 * by[i] + r12 * bz[i] + t1;
+        wz[i] = r20 * bx[i] + r21 * by[i] + r22 * bz[i] + t2;
+    }
+    for (int i = 0; i < feats_down_size; i++)
+    {
+        PointType &po = feats_down_world->points[i];
+        po.x = wx[i];
+        po.y = wy[i];
+        po.z = wz[i];
+        po.intensity = feats_down_body->points[i].intensity;
+    }
+}
+
+//; float雅可比 H_i = [ (p_i + t_li) x (R^T n_i), n_i ]，按列存成SoA，H^T H和H^T z累加到double
+void lio_jacobian_float(MD(6, 6) &HTH, VD(6) &HTz)
+{
+    const int n = effct_feat_num;
+    for (int k = 0; k < 6; k++)
+        H_soa[k].resize(n);
+    z_soa.resize(n);
+    const M3F rot_T = state.rot_end.transpose().cast<float>();
+    const V3F offset = Lidar_offset_to_IMU.cast<float>();
+    for (int i = 0; i < n; i++)
+    {
+        const PointType &laser_p = laserCloudOri->points[i];
+        const PointType &norm_p = corr_normvect->points[i];
+        float px = laser_p.x + offset(0), py = laser_p.y + offset(1), pz = laser_p.z + offset(2);
+        float ax = rot_T(0, 0) * norm_p.x + rot_T(0, 1) * norm_p.y + rot_T(0, 2) * norm_p.z;
+        float ay = rot_T(1, 0) * norm_p.x + rot_T(1, 1) * norm_p.y + rot_T(1, 2) * norm_p.z;
+        float az = rot_T(2, 0) * norm_p.x + rot_T(2, 1) * norm_p.y + rot_T(2, 2) * norm_p.z;
+        H_soa[0][i] = py * az - pz * ay;
+        H_soa[1][i] = pz * ax - px * az;
+        H_soa[2][i] = px * ay - py * ax;
+        H_soa[3][i] = norm_p.x;
+        H_soa[4][i] = norm_p.y;
+        H_soa[5][i] = norm_p.z;
+        z_soa[i] = -norm_p.intensity;
+    }
+    const float *z = z_soa.data();
+    for (int a = 0; a < 6; a++)
+    {
+        const float *ha = H_soa[a].data();
+        for (int b = a; b < 6; b++)
+        {
+            const float *hb = H_soa[b].data();
+            double sum = 0;
+#ifdef MP_EN
+            #pragma omp simd reduction(+ : sum)
+#endif
+            for (int i = 0; i < n; i++)
+                sum += ha[i] * hb[i];
+            HTH(a, b) = HTH(b, a) = sum;
+        }
+        double sum = 0;
+#ifdef MP_EN
+        #pragma omp simd reduction(+ : sum)
+#endif
+        for (int i = 0; i < n; i++)
+            sum += ha[i] * z[i];
+        HTz(a) = sum;
+    }
+}
+
+//; 按雅可比行对H^T H各特征方向的贡献选点: 从最弱的方向开始，每个方向选投影最大的info_select_num/6个点，
+//; 这样弱方向的约束不会被大量同方向的点(比如地面)淹没。没选中的点这一帧后面的迭代不再匹配
+void info_select(const MD(6, 6) &HTH)
+{
+    const int n = effct_feat_num;
+    SelfAdjointEigenSolver<MD(6, 6)> es(HTH);
+    const MF(6, 6) V = es.eigenvectors().cast<float>();
+    vector<float> score(n);
+    vector<int> cand;
+    vector<bool> taken(n, false);
+    const int quota = info_select_num / 6;
+    for (int k = 0; k < 6; k++) //; 特征值升序，弱方向先选
+    {
+        cand.clear();
+        for (int i = 0; i < n; i++)
+        {
+            if (taken[i])
+                continue;
+            float proj = 0;
+            for (int j = 0; j < 6; j++)
+                proj += H_soa[j][i] * V(j, k);
+            score[i] = fabs(proj);
+            cand.push_back(i);
+        }
+        int m = min(quota, int(cand.size()));
+        nth_element(cand.begin(), cand.begin() + m, cand.end(), [&score](int a, int b) { return score[a] > score[b]; });
+        for (int j = 0; j < m; j++)
+            taken[cand[j]] = true;
+    }
+    point_info_keep.assign(feats_down_size, false);
+    for (int i = 0; i < n; i++)
+    {
+        if (taken[i])
+            point_info_keep[effct_index[i]] = true;
+    }
+    info_select_frames++;
+}
+
 void RGBpointBodyToWorld(PointType const *const pi, PointType *const po)//RGB点，从body坐标系到world坐标系
 {
     V3D p_body(pi->x, pi->y, pi->z);
@@ -319,11 +531,21 @@ void RGBpointBodyToWorld(PointType const *const pi, PointType *const po)//RGB点
 #ifndef USE_ikdforest
 int points_cache_size = 0;
 
+void fov_stash_removed(PointVector &points_history);
+
 void points_cache_collect() //; 收集删除的点云
 {
-    PointVector points_history;
-    ikdtree.acquire_removed_points(points_history);//; 获取删除的点云
-    points_cache_size = points_history.size();
+    PointVector points_history, points_evicted;
+    lidar_map->acquire_removed_points(points_history);//; 获取删除的点云
+    lidar_map->acquire_evicted_points(points_evicted);//; iVox容量淘汰的点，不是FOV裁剪删的，不能进FOV的暂存
+    points_cache_size = points_history.size() + points_evicted.size();
+    if (plane_cache_en)
+        plane_cache.Remove(points_evicted); //; 淘汰的体素不会经过盒子删除，平面缓存里要单独减掉
+    if (fov_segment_en)
+        fov_stash_removed(points_history);
+    points_history.insert(points_history.end(), points_evicted.begin(), points_evicted.end());
+    if (tile_store_en)
+        tile_store.Store(points_history); //; 不再丢掉，交给后台线程写盘
 }
 
 #endif
@@ -355,6 +577,183 @@ BoxPointType get_cube_point(float xmin, float ymin, float zmin, float xmax, floa
     return cube_points;
 }
 
+/*** FOV模式: 地图按fov_box_length划分成盒子，离开FOV锥体的盒子从地图中删掉，重新进入时再加回来 ***/
+FOV_Checker fov_checker;
+unordered_map<VOXEL_KEY, bool> fov_boxes;   //; 地图中有点的盒子，是否在FOV内
+unordered_map<VOXEL_KEY, PointVector> fov_box_stash;   //; 不在FOV内的盒子里被地图真正删掉的点
+V3D fov_last_pos(0, 0, 0), fov_last_axis(0, 0, 0);
+bool fov_force_update = true;
+int fov_active_box_num = 0;
+
+VOXEL_KEY fov_box_key(float x, float y, float z)
+{
+    return VOXEL_KEY(floor(x / fov_box_length), floor(y / fov_box_length), floor(z / fov_box_length));
+}
+
+BoxPointType fov_box_of(const VOXEL_KEY &key)
+{
+    BoxPointType box;
+    box.vertex_min[0] = key.x * fov_box_length;
+    box.vertex_min[1] = key.y * fov_box_length;
+    box.vertex_min[2] = key.z * fov_box_length;
+    for (int i = 0; i < 3; i++)
+        box.vertex_max[i] = box.vertex_min[i] + fov_box_length;
+    return box;
+}
+
+//; 盒子重新进入FOV: 恢复还在ikd-Tree里的被删除点，并把存起来的点加回地图
+void fov_box_restore(const VOXEL_KEY &key, vector<BoxPointType> &boxes_add, PointVector &points_add)
+{
+    boxes_add.push_back(fov_box_of(key));
+    auto stash = fov_box_stash.find(key);
+    if (stash != fov_box_stash.end())
+    {
+        points_add.insert(points_add.end(), stash->second.begin(), stash->second.end());
+        fov_box_stash.erase(stash);
+    }
+}
+
+//; 盒子删除时平面缓存里对应的体素也删掉了，盒子恢复后用地图里真正留下的点重新统计
+void fov_plane_cache_restore(const vector<BoxPointType> &boxes_add)
+{
+    if (!plane_cache_en)
+        return;
+    PointVector points_box;
+    for (int i = 0; i < boxes_add.size(); i++)
+    {
+        //; 体素和盒子不对齐时，中心在盒子内的体素会伸出盒子一点，多搜一圈
+        BoxPointType box = boxes_add[i];
+        for (int j = 0; j < 3; j++)
+        {
+            box.vertex_min[j] -= plane_cache_voxel_size;
+            box.vertex_max[j] += plane_cache_voxel_size;
+        }
+        lidar_map->Box_Search(box, points_box);
+        plane_cache.Rebuild_Box(boxes_add[i], points_box);
+    }
+}
+
+//; 记录新加入地图的点所在的盒子，点落进了已经删掉的盒子就先把盒子恢复，下一帧再重新判断
+void fov_boxes_register(const PointVector &points)
+{
+    vector<BoxPointType> boxes_add;
+    PointVector points_add;
+    for (int i = 0; i < points.size(); i++)
+    {
+        VOXEL_KEY key = fov_box_key(points[i].x, points[i].y, points[i].z);
+        auto result = fov_boxes.emplace(key, true);
+        if (result.second || result.first->second)
+            continue;
+        result.first->second = true;
+        fov_box_restore(key, boxes_add, points_add);
+        fov_force_update = true;
+    }
+    if (!boxes_add.empty())
+        lidar_map->Add_Point_Boxes(boxes_add);
+    if (!points_add.empty())
+        lidar_map->Add_Points(points_add, false);
+    fov_plane_cache_restore(boxes_add);
+}
+
+//; 局部地图裁剪掉的盒子不再管理，它们被删掉的点也不会再加回来
+void fov_boxes_forget(const vector<BoxPointType> &boxes)
+{
+    for (auto iter = fov_boxes.begin(); iter != fov_boxes.end();)
+    {
+        BoxPointType box = fov_box_of(iter->first);
+        bool overlap = false;
+        for (int i = 0; i < boxes.size() && !overlap; i++)
+        {
+            overlap = true;
+            for (int j = 0; j < 3; j++)
+            {
+                if (box.vertex_max[j] <= boxes[i].vertex_min[j] || box.vertex_min[j] >= boxes[i].vertex_max[j])
+                    overlap = false;
+            }
+        }
+        if (overlap)
+        {
+            fov_box_stash.erase(iter->first);
+            iter = fov_boxes.erase(iter);
+        }
+        else
+            ++iter;
+    }
+}
+
+//; 地图真正删掉的点(ikd-Tree重建时丢掉的被删除点，iVox盒子删除的点)，属于FOV外的盒子就先存起来
+//; 局部地图裁剪的盒子已经被fov_boxes_forget忘掉了，这些点留在points_history里; 容量淘汰的点根本不会传进来
+void fov_stash_removed(PointVector &points_history)
+{
+    PointVector points_readd, points_rest;
+    for (int i = 0; i < points_history.size(); i++)
+    {
+        VOXEL_KEY key = fov_box_key(points_history[i].x, points_history[i].y, points_history[i].z);
+        auto iter = fov_boxes.find(key);
+        if (iter == fov_boxes.end())
+        {
+            points_rest.push_back(points_history[i]);
+            continue;
+        }
+        if (iter->second)
+            points_readd.push_back(points_history[i]); //; 重建开始后盒子又回到了FOV内
+        else
+            fov_box_stash[key].push_back(points_history[i]);
+    }
+    if (!points_readd.empty())
+    {
+        lidar_map->Add_Points(points_readd, false);
+        if (plane_cache_en)
+            plane_cache.Update(points_readd); //; 盒子恢复时这些点还不在地图里，没有统计进去
+    }
+    points_history.swap(points_rest);
+}
+
+void lasermap_fov_trim()
+{
+    points_cache_collect();
+    V3D pos_LiD = state.pos_end;
+    V3D axis = V3D(XAxisPoint_world(0), XAxisPoint_world(1), XAxisPoint_world(2)) - pos_LiD;
+    axis.normalize();
+    //; 位置和朝向变化不大时盒子的可见性基本不变，不用每帧都判断
+    if (!fov_force_update && (pos_LiD - fov_last_pos).norm() < 0.5 * fov_box_length && axis.dot(fov_last_axis) > cos(2.0 * PI_M / 180.0))
+        return;
+    fov_force_update = false;
+    fov_last_pos = pos_LiD;
+    fov_last_axis = axis;
+    double theta = (fov_deg * 0.5 + fov_margin_deg) * PI_M / 180.0;
+    vector<BoxPointType> boxes_delete, boxes_add;
+    PointVector points_add;
+    fov_active_box_num = 0;
+    for (auto iter = fov_boxes.begin(); iter != fov_boxes.end(); ++iter)
+    {
+        BoxPointType box = fov_box_of(iter->first);
+        bool visible = fov_checker.check_box(pos_LiD, axis, theta, fov_depth, box);
+        if (visible)
+            fov_active_box_num++;
+        if (visible == iter->second)
+            continue;
+        iter->second = visible;
+        if (!visible)
+        {
+            boxes_delete.push_back(box);
+            continue;
+        }
+        fov_box_restore(iter->first, boxes_add, points_add);
+    }
+    if (!boxes_delete.empty())
+    {
+        lidar_map->Delete_Point_Boxes(boxes_delete);
+        if (plane_cache_en)
+            plane_cache.Delete_Boxes(boxes_delete);
+    }
+    if (!boxes_add.empty())
+        lidar_map->Add_Point_Boxes(boxes_add);
+    if (!points_add.empty())
+        lidar_map->Add_Points(points_add, false);
+    fov_plane_cache_restore(boxes_add);
+}
+
 #ifndef USE_ikdforest
 BoxPointType LocalMap_Points;   //; 本地地图的点云
 bool Localmap_Initialized = false;  //; 是否初始化了本地地图
@@ -427,17 +826,63 @@ void lasermap_fov_segment()
     points_cache_collect();
     double delete_begin = omp_get_wtime();  //; 删除开始时间
     if (cub_needrm.size() > 0)
-        kdtree_delete_counter = ikdtree.Delete_Point_Boxes(cub_needrm);
+        kdtree_delete_counter = lidar_map->Delete_Point_Boxes(cub_needrm);
+    if (plane_cache_en)
+        plane_cache.Delete_Boxes(cub_needrm);
     kdtree_delete_time = omp_get_wtime() - delete_begin;
+    if (fov_segment_en)
+        fov_boxes_forget(cub_needrm);
     //    printf("Delete time: %0.6f, delete size: %d\n", kdtree_delete_time, kdtree_delete_counter);
     // printf("Delete Box: %d\n",int(cub_needrm.size()));
 }
 
+//; 请求和局部地图cube(以及按匀速预测平移后的cube)相交的tile，只把落在当前cube里的点加回地图
+//; cube移动时lasermap_fov_segment会把出去的部分删掉，加回来的点不会让地图超出cube
+void lasermap_tile_stream()
+{
+    if (!Localmap_Initialized)
+        return;
+    tile_store.Prefetch(LocalMap_Points, state.vel_end * tile_prefetch_time);
+    PointVector tile_points;
+    if (!tile_store.Fetch(LocalMap_Points, tile_points))
+        return;
+    PointVector points_added, points_removed;
+    lidar_map->Add_Points(tile_points, true, &points_added, &points_removed);
+    if (plane_cache_en)
+    {
+        plane_cache.Update(points_added);
+        plane_cache.Remove(points_removed);
+    }
+    if (fov_segment_en)
+        fov_boxes_register(tile_points);
+}
+
 #endif
 
+//; 后台预处理线程处理完一帧后调用，和回调里直接处理后的入队一样
+void ingest_deliver(double stamp, PointCloudXYZI::Ptr ptr)
+{
+    mtx_buffer.lock();
+    if (stamp < last_timestamp_lidar)
+    {
+        ROS_ERROR("lidar loop back, clear buffer");
+        lidar_buffer.clear();
+    }
+    lidar_buffer.push_back(ptr);
+    time_buffer.push_back(stamp);
+    last_timestamp_lidar = stamp;
+    mtx_buffer.unlock();
+    sig_buffer.notify_all();
+}
+
 //; 通用LiDAR类型的回调函数，比如机械式的LiDAR
 void standard_pcl_cbk(const sensor_msgs::PointCloud2::ConstPtr &msg)
 {
+    if (ingest_thread_en)
+    {
+        scan_ingest.push(msg);
+        return;
+    }
     mtx_buffer.lock();  //; 加锁
     // cout<<"got feature"<<endl;
     if (msg->header.stamp.toSec() < last_timestamp_lidar)
@@ -464,6 +909,11 @@ void standard_pcl_cbk(const sensor_msgs::PointCloud2::ConstPtr &msg)
 //; livox激光雷达的消息回调函数
 void livox_pcl_cbk(const livox_ros_driver::CustomMsg::ConstPtr &msg)
 {
+    if (ingest_thread_en)
+    {
+        scan_ingest.push(msg);
+        return;
+    }
     mtx_buffer.lock();
     if (msg->header.stamp.toSec() < last_timestamp_lidar)
     {
@@ -506,6 +956,8 @@ void imu_cbk(const sensor_msgs::Imu::ConstPtr &msg_in)
     // cout<<"got imu: "<<timestamp<<" imu size "<<imu_buffer.size()<<endl;
     mtx_buffer.unlock();
     sig_buffer.notify_all();
+    if (imu_odom_en)
+        imu_propagator.push_imu(msg);
 }
 
 /**
@@ -633,8 +1085,9 @@ bool sync_packages(LidarMeasureGroup &meas)
             return false;
         }
         // sort by sample timestamp; small to big
-        //; 对lidar中的点云根据时间戳进行排序
-        sort(meas.lidar->points.begin(), meas.lidar->points.end(), time_list); 
+        //; 点云在Preprocess里已经按时间排好序了，这里只做一遍线性检查，没排好的才排序
+        if (!is_sorted(meas.lidar->points.begin(), meas.lidar->points.end(), time_list))
+            sort(meas.lidar->points.begin(), meas.lidar->points.end(), time_list);
         // generate lidar_beg_time // 雷达开始时间
         meas.lidar_beg_time = time_buffer.front();   
         //; 一帧lidar结束的绝对时间戳                          
@@ -753,6 +1206,29 @@ bool sync_packages(LidarMeasureGroup &meas)
     return true;
 }
 
+//; 把一帧世界系的点插入地图，异步插入时在map_inserter的线程里调用
+void map_insert_apply(PointVector &points)
+{
+#ifdef USE_ikdtree
+#ifdef USE_ikdforest
+    ikdforest.Add_Points(points, lidar_end_time);
+    if (plane_cache_en)
+        plane_cache.Update(points);
+#else
+    //; 降采样会丢掉或替换掉一部分点，平面缓存只跟着地图里真正的变化走
+    PointVector points_added, points_removed;
+    lidar_map->Add_Points(points, true, &points_added, &points_removed);
+    if (plane_cache_en)
+    {
+        plane_cache.Update(points_added);
+        plane_cache.Remove(points_removed); //; iVox里同一批先加进去的点也可能被后面的点替换，要先加后减
+    }
+#endif
+#endif
+    if (fov_segment_en)
+        fov_boxes_register(points);
+}
+
 void map_incremental()//地图增量更新
 {
     for (int i = 0; i < feats_down_size; i++)
@@ -760,13 +1236,13 @@ void map_incremental()//地图增量更新
         /* transform to world frame */
         pointBodyToWorld(&(feats_down_body->points[i]), &(feats_down_world->points[i]));
     }
-#ifdef USE_ikdtree
-#ifdef USE_ikdforest
-    ikdforest.Add_Points(feats_down_world->points, lidar_end_time);
-#else
-    ikdtree.Add_Points(feats_down_world->points, true);
-#endif
-#endif
+    if (map_insert_async_en)
+    {
+        PointVector points(feats_down_world->points.begin(), feats_down_world->points.end());
+        map_inserter.submit(points);
+        return;
+    }
+    map_insert_apply(feats_down_world->points);
 }
 
 // PointCloudXYZRGB::Ptr pcl_wait_pub_RGB(new PointCloudXYZRGB(500000, 1));
@@ -780,27 +1256,36 @@ void publish_frame_world_rgb(const ros::Publisher &pubLaserCloudFullRes, lidar_s
     PointCloudXYZRGB::Ptr laserCloudWorldRGB(new PointCloudXYZRGB(size, 1));
     if (img_en) //; 如果有图像信息
     {
-        laserCloudWorldRGB->clear();
-        for (int i = 0; i < size; i++)
-        {
-            PointTypeRGB pointRGB;
-            pointRGB.x = pcl_wait_pub->points[i].x;
-            pointRGB.y = pcl_wait_pub->points[i].y;
-            pointRGB.z = pcl_wait_pub->points[i].z;
-            V3D p_w(pointRGB.x, pointRGB.y, pointRGB.z);
-            V2D pc(lidar_selector->new_frame_->w2c(p_w));//point in camera
-            //; 把上一帧的LIDAR点云投影到当前帧的相机坐标系下，找对应的颜色给点云赋值
-            if (lidar_selector->new_frame_->cam_->isInFrame(pc.cast<int>(), 0))//; 如果点在图像内
+        //; 每个点各自上色，放在线程池的可视化优先级上；最后按原顺序把图像内的点拼起来
+        vector<uint8_t> in_frame(size, 0);
+        parallel_for(&task_scheduler, 0, size, [&](int beg, int end) {
+            for (int i = beg; i < end; i++)
             {
-                // cv::Mat img_cur = lidar_selector->new_frame_->img();
-                cv::Mat img_rgb = lidar_selector->img_rgb;
-                V3F pixel = lidar_selector->getpixel(img_rgb, pc);
-                pointRGB.r = pixel[2]; // rgb信息
-                pointRGB.g = pixel[1];
-                pointRGB.b = pixel[0];
-                laserCloudWorldRGB->push_back(pointRGB);
+                PointTypeRGB &pointRGB = laserCloudWorldRGB->points[i];
+                pointRGB.x = pcl_wait_pub->points[i].x;
+                pointRGB.y = pcl_wait_pub->points[i].y;
+                pointRGB.z = pcl_wait_pub->points[i].z;
+                V3D p_w(pointRGB.x, pointRGB.y, pointRGB.z);
+                V2D pc(lidar_selector->new_frame_->w2c(p_w));//point in camera
+                //; 把上一帧的LIDAR点云投影到当前帧的相机坐标系下，找对应的颜色给点云赋值
+                if (lidar_selector->new_frame_->cam_->isInFrame(pc.cast<int>(), 0))//; 如果点在图像内
+                {
+                    // cv::Mat img_cur = lidar_selector->new_frame_->img();
+                    V3F pixel = lidar_selector->getpixel(lidar_selector->img_rgb, pc);
+                    pointRGB.r = pixel[2]; // rgb信息
+                    pointRGB.g = pixel[1];
+                    pointRGB.b = pixel[0];
+                    in_frame[i] = 1;
+                }
             }
+        }, TASK_VISUAL, 256);
+        int num = 0;
+        for (int i = 0; i < size; i++)
+        {
+            if (in_frame[i])
+                laserCloudWorldRGB->points[num++] = laserCloudWorldRGB->points[i];
         }
+        laserCloudWorldRGB->resize(num);
     }
     if (1) //if(publish_count >= PUBFRAME_PERIOD)
     {
@@ -966,6 +1451,41 @@ void readParameters(ros::NodeHandle &nh)
     nh.param<double>("filter_size_map", filter_size_map_min, 0.5);
     nh.param<double>("cube_side_length", cube_len, 200);// cube地图的边长
     nh.param<double>("mapping/fov_degree", fov_deg, 180); // FOV
+    nh.param<int>("mapping/map_backend", map_backend, MAP_IKDTREE); // 地图后端 0:ikd-Tree 1:iVox
+    nh.param<double>("mapping/ivox_grid_resolution", ivox_grid_resolution, 0.5); // iVox体素大小
+    nh.param<int>("mapping/ivox_nearby_type", ivox_nearby_type, NEARBY18); // iVox近邻体素 0/6/18/26
+    nh.param<bool>("mapping/plane_cache_en", plane_cache_en, false); // 体素平面缓存
+    nh.param<double>("mapping/plane_cache_voxel_size", plane_cache_voxel_size, 1.0);
+    nh.param<int>("mapping/plane_cache_min_points", plane_cache_min_points, 10);
+    nh.param<double>("mapping/plane_cache_thickness", plane_cache_thickness, 0.03); // 平面厚度阈值
+    nh.param<double>("mapping/neighbour_reuse_ratio", neighbour_reuse_ratio, 0.1); // 近邻复用的位移比例
+    nh.param<bool>("mapping/lio_float_en", lio_float_en, false); // LIO残差和雅可比用float计算
+    nh.param<bool>("mapping/info_select_en", info_select_en, false); // 按信息矩阵贡献选点
+    nh.param<int>("mapping/info_select_num", info_select_num, 1000);
+    nh.param<double>("mapping/degeneracy_thresh", degeneracy_thresh, 0.0); // 退化检测阈值
+    nh.param<int>("mapping/downsample_mode", downsample_mode, VOXEL_CENTROID); // 体素降采样模式
+    nh.param<bool>("mapping/point_budget_en", point_budget_en, false); // 按耗时上限自适应点数
+    nh.param<double>("mapping/lio_deadline", lio_deadline, 50.0);
+    nh.param<double>("mapping/budget_leaf_max", budget_leaf_max, 2.0);
+    nh.param<int>("mapping/undistort_mode", undistort_mode, UNDISTORT_APPROX); // 去畸变模式
+    nh.param<string>("mapping/prior_map_file", prior_map_file, ""); // 先验地图快照
+    nh.param<string>("mapping/map_save_file", map_save_file, "");
+    nh.param<bool>("mapping/map_save_attributes", map_save_attributes, true);
+    nh.param<bool>("mapping/fov_segment_en", fov_segment_en, false); // 只保留FOV内的地图盒子
+    nh.param<double>("mapping/fov_box_length", fov_box_length, 10.0);
+    nh.param<double>("mapping/fov_margin_deg", fov_margin_deg, 10.0);
+    nh.param<double>("mapping/fov_depth", fov_depth, 100.0);
+    nh.param<bool>("mapping/tile_store_en", tile_store_en, false); // 磁盘tile地图
+    nh.param<bool>("mapping/imu_odom_en", imu_odom_en, false); // IMU频率的位姿输出
+    nh.param<bool>("mapping/ingest_thread_en", ingest_thread_en, false); // 后台线程预处理
+    nh.param<int>("mapping/ingest_queue_size", ingest_queue_size, 4);
+    nh.param<bool>("mapping/map_insert_async_en", map_insert_async_en, false); // 后台线程插入地图
+    nh.param<int>("mapping/thread_num", thread_num, MP_PROC_NUM); // 线程池的线程数
+    nh.param<vector<int>>("mapping/thread_cores", thread_cores, vector<int>()); // 线程池绑核
+    nh.param<int>("mapping/map_insert_max_lag", map_insert_max_lag, 0);
+    nh.param<string>("mapping/tile_dir", tile_dir, "Log/tiles/");
+    nh.param<double>("mapping/tile_size", tile_size, 50.0);
+    nh.param<double>("mapping/tile_prefetch_time", tile_prefetch_time, 3.0);
     nh.param<double>("mapping/gyr_cov_scale", gyr_cov_scale, 1.0);// 陀螺仪的协方差
     nh.param<double>("mapping/acc_cov_scale", acc_cov_scale, 1.0);// 加速度计的协方差
     nh.param<double>("preprocess/blind", p_pre->blind, 0.01);// 激光雷达的盲区
@@ -1004,6 +1524,7 @@ int main(int argc, char **argv)
     ros::Publisher pubLaserCloudEffect = nh.advertise<sensor_msgs::PointCloud2>("/cloud_effected", 100);
     ros::Publisher pubLaserCloudMap = nh.advertise<sensor_msgs::PointCloud2>("/Laser_map", 100);
     ros::Publisher pubOdomAftMapped = nh.advertise<nav_msgs::Odometry>("/aft_mapped_to_init", 10);
+    ros::Publisher pubOdomImu = nh.advertise<nav_msgs::Odometry>("/aft_mapped_to_init_imu", 200);
     ros::Publisher pubPath = nh.advertise<nav_msgs::Path>("/path", 10);
 
     path.header.stamp = ros::Time::now();
@@ -1012,12 +1533,16 @@ int main(int argc, char **argv)
     /*** variables definition ***/
     VD(DIM_STATE) solution; // 18*1 解向量
     MD(DIM_STATE, DIM_STATE) G, H_T_H, I_STATE; // 18*18 矩阵
+    InfoFormSolver info_solver; //; IEKF增益的求解，state.cov的分解在一帧的迭代中复用
     V3D rot_add, t_add; // 旋转增量和平移增量
     StatesGroup state_propagat; // 状态传播
     PointType pointOri, pointSel, coeff; // 点类型变量
 
     int effect_feat_num = 0, frame_num = 0; // 有效特征点数量和帧数
     double deltaT, deltaR, aver_time_consu = 0, aver_time_icp = 0, aver_time_match = 0, aver_time_solve = 0, aver_time_const_H_time = 0; // 时间相关变量
+    double aver_time_incre = 0, aver_time_search = 0; // 地图增量和单次近邻搜索的平均时间，用来对比不同的地图后端
+    double aver_time_downsample = 0; // 扫描降采样的平均时间
+    double aver_time_undistort = 0; // 去畸变的平均时间
 
     FOV_DEG = (fov_deg + 10.0) > 179.9 ? 179.9 : (fov_deg + 10.0); // 视场角度
     HALF_FOV_COS = cos((FOV_DEG)*0.5 * PI_M / 180.0); // 半视场角的余弦值 // TODO：没用到，传入fov_deg有什么用？
@@ -1025,6 +1550,62 @@ int main(int argc, char **argv)
     // 降采样系数
     downSizeFilterSurf.setLeafSize(filter_size_surf_min, filter_size_surf_min, filter_size_surf_min); // 设置表面降采样滤波器的叶子大小
     downSizeFilterMap.setLeafSize(filter_size_map_min, filter_size_map_min, filter_size_map_min); // 设置地图降采样滤波器的叶子大小
+    downSizeFilterSurf.set_select_mode(downsample_mode);
+    downSizeFilterMap.set_select_mode(downsample_mode);
+    point_budget.init(lio_deadline * 1e-3, filter_size_surf_min, budget_leaf_max);
+
+    //; 线程池，所有并行段共用
+    task_scheduler.init(thread_num, thread_cores);
+    downSizeFilterSurf.set_scheduler(&task_scheduler);
+    downSizeFilterMap.set_scheduler(&task_scheduler);
+    p_pre->scheduler = &task_scheduler;
+    p_pre->task_priority = ingest_thread_en ? TASK_MAP : TASK_CRITICAL; //; 后台预处理下一帧时让估计器先用线程
+
+    //; 地图后端
+    if (map_backend == MAP_IVOX)
+        lidar_map.reset(new IVoxMap(ivox_grid_resolution, ivox_nearby_type));
+    else
+        lidar_map.reset(new IkdTreeMap());
+    lidar_map->set_scheduler(&task_scheduler);
+    cout << "[ mapping ]: map backend: " << lidar_map->name() << endl;
+    //; 先验地图需要和本次启动在同一个世界坐标系下，也就是从上次建图的起点启动
+    if (!prior_map_file.empty())
+    {
+        if (prior_map_file[0] != '/')
+            prior_map_file = root_dir + prior_map_file;
+        double load_start = omp_get_wtime();
+        if (lidar_map->load_snapshot(prior_map_file))
+        {
+            lidar_map->set_downsample_param(filter_size_map_min);
+            printf("[ mapping ]: load prior map %s, %d points, %0.3f s\n", prior_map_file.c_str(), lidar_map->size(),
+                   omp_get_wtime() - load_start);
+        }
+        else
+            ROS_WARN("Failed to load prior map %s", prior_map_file.c_str());
+    }
+    plane_cache.set_param(plane_cache_voxel_size, plane_cache_min_points, plane_cache_thickness);
+    fov_checker.Set_BoxLength(fov_box_length);
+    if (tile_store_en)
+    {
+        if (tile_dir[0] != '/')
+            tile_dir = root_dir + tile_dir;
+        tile_store.init(tile_dir, tile_size);
+    }
+    if (imu_odom_en)
+        imu_propagator.init(pubOdomImu);
+    if (ingest_thread_en)
+        scan_ingest.init(p_pre, ingest_queue_size, ingest_deliver);
+    if (map_insert_async_en)
+        map_inserter.init(map_insert_apply);
+    if ((plane_cache_en || fov_segment_en) && !lidar_map->empty())
+    {
+        PointVector prior_points;
+        lidar_map->flatten(prior_points);
+        if (plane_cache_en)
+            plane_cache.Update(prior_points);
+        if (fov_segment_en)
+            fov_boxes_register(prior_points);
+    }
 
     //; IMU处理的函数
     shared_ptr<ImuProcess> p_imu(new ImuProcess());
@@ -1067,6 +1648,7 @@ int main(int argc, char **argv)
     lidar_selector->cy = cam_cy;
     //; NCC是归一化相关性，是相比使用patch对齐的更复杂的差异度量方式，见十四讲P230
     lidar_selector->ncc_en = ncc_en; // 0
+    lidar_selector->downSizeFilter.set_scheduler(&task_scheduler);
     lidar_selector->init();
     //------------------------------- vio 部分变量初始化完毕 --------------------------
 
@@ -1079,6 +1661,8 @@ int main(int argc, char **argv)
     //    p_imu->set_acc_bias_cov(V3D(0.00001, 0.00001, 0.00001));
     p_imu->set_gyr_bias_cov(V3D(0.00003, 0.00003, 0.00003));
     p_imu->set_acc_bias_cov(V3D(0.01, 0.01, 0.01));
+    p_imu->set_undistort_mode(undistort_mode);
+    p_imu->set_scheduler(&task_scheduler);
 
     G.setZero();
     H_T_H.setZero();
@@ -1222,6 +1806,8 @@ int main(int argc, char **argv)
                 //从欧拉加输出四元数msg
                 geoQuat = tf::createQuaternionMsgFromRollPitchYaw(euler_cur(0), euler_cur(1), euler_cur(2));
                 publish_odometry(pubOdomAftMapped);
+                if (imu_odom_en)
+                    imu_propagator.set_anchor(state, LidarMeasures.last_update_time, p_imu->get_acc_scale());
                 euler_cur = RotMtoEuler(state.rot_end);
                 fout_out << setw(20) << LidarMeasures.last_update_time - first_lidar_time << " "
                          << euler_cur.transpose() * 57.3 << " " << state.pos_end.transpose() << " "
@@ -1234,24 +1820,42 @@ int main(int argc, char **argv)
         }
 
         // Step 4: 运行到这里，说明当前是LiDAR帧，则运行LIO
+        //; 异步插入时，从FOV裁剪到IEKF结束都持有地图锁，后台线程在这之外插入前面的帧
+        std::unique_lock<std::mutex> map_lock;
+        if (map_insert_async_en)
+            map_lock = map_inserter.acquire(map_insert_max_lag);
         /*** Segment the map in lidar FOV ***/
         lasermap_fov_segment();//过滤在当前LiDAR的FOV内的点云，也就是自动移动局部地图，保证激光雷达坐标始终在局部地图的中心附近
+        if (fov_segment_en)
+            lasermap_fov_trim();
+        if (tile_store_en)
+            lasermap_tile_stream();
 
         /*** 下采样扫描到的点 ***/
+        double downsample_start = omp_get_wtime();
+        if (point_budget_en)
+            downSizeFilterSurf.setLeafSize(point_budget.leaf_size(), point_budget.leaf_size(), point_budget.leaf_size());
         downSizeFilterSurf.setInputCloud(feats_undistort);
         downSizeFilterSurf.filter(*feats_down_body);
+        int feats_down_raw = feats_down_body->points.size();
+        bool budget_subset = point_budget_en && point_budget.select(*feats_down_body); //; 分辨率调整慢一拍，超出的点这里裁掉
+        downsample_time = omp_get_wtime() - downsample_start;
 
         /*** 初始化 the map kdtree ***/
-        if (ikdtree.Root_Node == nullptr)
+        if (lidar_map->empty())
         {
             if (feats_down_body->points.size() > 5)
             {
-                ikdtree.set_downsample_param(filter_size_map_min);
-                ikdtree.Build(feats_down_body->points);
+                lidar_map->set_downsample_param(filter_size_map_min);
+                lidar_map->Build(feats_down_body->points);
+                if (plane_cache_en)
+                    plane_cache.Update(feats_down_body->points);
+                if (fov_segment_en)
+                    fov_boxes_register(feats_down_body->points);
             }
             continue;
         }
-        int featsFromMapNum = ikdtree.size();//地图中的点云数量
+        int featsFromMapNum = lidar_map->size();//地图中的点云数量
 
         feats_down_size = feats_down_body->points.size();//这次下采样的点云数量
         // cout << "[ LIO ]: Raw feature num: " << feats_undistort->points.size() << " downsamp num " << feats_down_size
@@ -1275,34 +1879,34 @@ int main(int argc, char **argv)
 
         if (0)//不执行跳过
         {
-            PointVector().swap(ikdtree.PCL_Storage);
-            ikdtree.flatten(ikdtree.Root_Node, ikdtree.PCL_Storage, NOT_RECORD);
             featsFromMap->clear();
-            featsFromMap->points = ikdtree.PCL_Storage;
+            lidar_map->flatten(featsFromMap->points);
         }
 
         point_selected_surf.resize(feats_down_size, true);
         pointSearchInd_surf.resize(feats_down_size);
         Nearest_Points.resize(feats_down_size);//最近点
+        search_center.resize(feats_down_size);
+        search_sq_dis.assign(feats_down_size, -1.0f); //; 每帧的点都是新的，近邻缓存全部失效
+        point_info_keep.assign(feats_down_size, true);
+        effct_index.resize(feats_down_size);
+        bool info_selected = false; //; 这一帧是否已经选过点
         int rematch_num = 0;
         bool nearest_search_en = true; //
+        vector<int> plane_fit_index;    //; 需要拟合平面的点的索引
+        plane_fit_index.reserve(feats_down_size);
+        PlaneFitBatch plane_batch;
 
         t2 = omp_get_wtime();
 
         /*** iterated state estimation ***/
         double t_update_start = omp_get_wtime();
 
-        if (img_en)
-        {
-            omp_set_num_threads(MP_PROC_NUM); // 设置线程的默认周期数为MP_PROC_NUM 4
-// #pragma omp parallel for // 并行计算，疑似写错了
-//             for (int i = 0; i < 1; i++)
-//             {
-//             }
-        }
-
         if (lidar_en)
         {
+            info_solver.set_prior(state.cov, LASER_POINT_COV); //; 迭代中state.cov不变，只分解一次
+            if (lio_float_en)
+                body_to_soa();
             for (iterCount = -1; iterCount < NUM_MAX_ITERATIONS && flg_EKF_inited; iterCount++)//迭代优化
             {
                 match_start = omp_get_wtime();
@@ -1311,51 +1915,87 @@ int main(int argc, char **argv)
                 // laserCloudOri->clear();
                 // corr_normvect->clear();
                 total_residual = 0.0;
+                plane_fit_index.clear();
+
+                if (lio_float_en)
+                    body_to_world_float();
 
                 /** closest surface search and residual computation **/
                 for (int i = 0; i < feats_down_size; i++)
                 {
                     PointType &point_body = feats_down_body->points[i];
                     PointType &point_world = feats_down_world->points[i];
-                    V3D p_body(point_body.x, point_body.y, point_body.z);
                     /* transform to world frame */
-                    pointBodyToWorld(&point_body, &point_world);//之前point_world是空的，现在赋值了
+                    if (!lio_float_en)
+                        pointBodyToWorld(&point_body, &point_world);//之前point_world是空的，现在赋值了
+                    if (!point_info_keep[i]) //; 信息选点时被去掉的点，世界坐标还要用来更新地图
+                    {
+                        point_selected_surf[i] = false;
+                        continue;
+                    }
                     vector<float> pointSearchSqDis(NUM_MATCH_POINTS); // #define 5，点搜索的距离
 
                     auto &points_near = Nearest_Points[i];
                     uint8_t search_flag = 0;
+                    VF(4) pabcd; // Matrix<float, (4), 1>
+
+                    //; 落在可信平面体素里的点直接用缓存的平面，不用近邻搜索和平面拟合
+                    if (plane_cache_en && plane_cache.Query(point_world, pabcd))
+                    {
+                        points_near.clear();
+                        point_selected_surf[i] = plane_residual(i, pabcd);
+                        continue;
+                    }
+
                     double search_start = omp_get_wtime();
-                    if (nearest_search_en)
+                    //; 上一次命中了平面缓存的点没有近邻，需要补一次搜索
+                    if (nearest_search_en || (plane_cache_en && points_near.empty()))
                     {
-                        /** Find the closest surfaces in the map **/
-                        ikdtree.Nearest_Search(point_world, NUM_MATCH_POINTS, points_near, pointSearchSqDis);//ikdtree搜索得到最近的5个点
-                        point_selected_surf[i] = pointSearchSqDis[NUM_MATCH_POINTS - 1] > 5 ? false : true;//如果最后一个点的距离大于5，则不选取
-                        kdtree_search_time += omp_get_wtime() - search_start;
-                        kdtree_search_counter++;
+                        V3F p_world(point_world.x, point_world.y, point_world.z);
+                        neighbour_query_num++;
+                        //; 重新匹配时点只移动了近邻半径的一小部分，近邻集合基本不会变，直接复用
+                        if (search_sq_dis[i] >= 0 && points_near.size() == NUM_MATCH_POINTS &&
+                            (p_world - search_center[i]).squaredNorm() < neighbour_reuse_ratio * neighbour_reuse_ratio * search_sq_dis[i])
+                        {
+                            point_selected_surf[i] = search_sq_dis[i] <= 5;
+                            neighbour_reuse_num++;
+                        }
+                        else
+                        {
+                            /** Find the closest surfaces in the map **/
+                            lidar_map->Nearest_Search(point_world, NUM_MATCH_POINTS, points_near, pointSearchSqDis);//地图中搜索得到最近的5个点
+                            //; iVox在稀疏的地方可能搜不到5个点，返回的距离数组比NUM_MATCH_POINTS短
+                            point_selected_surf[i] = points_near.size() < NUM_MATCH_POINTS ? false : pointSearchSqDis[NUM_MATCH_POINTS - 1] <= 5;//如果最后一个点的距离大于5，则不选取
+                            kdtree_search_time += omp_get_wtime() - search_start;
+                            kdtree_search_counter++;
+                            search_center[i] = p_world;
+                            search_sq_dis[i] = points_near.size() == NUM_MATCH_POINTS ? pointSearchSqDis[NUM_MATCH_POINTS - 1] : -1.0f;
+                        }
                     }
 
                     if (!point_selected_surf[i] || points_near.size() < NUM_MATCH_POINTS)   // 如果不选取或者最近点小于5个
                         continue;
 
-                    //下面来判断这个点是否是平面上的点
-                    VF(4) pabcd; // Matrix<float, (4), 1>
+                    //下面来判断这个点是否是平面上的点，先记下来，后面批量拟合平面
                     point_selected_surf[i] = false; 
-                    if (esti_plane(pabcd, points_near, 0.1f)) //(planeValid)//判断点是否在平面上
+                    plane_fit_index.push_back(i);
+                }
+
+                /** 批量拟合平面，每次PLANE_FIT_LANES个点 **/
+                for (int k = 0; k < plane_fit_index.size(); k += PLANE_FIT_LANES)
+                {
+                    plane_batch.lanes = min(PLANE_FIT_LANES, int(plane_fit_index.size()) - k);
+                    for (int l = 0; l < plane_batch.lanes; l++)
+                        plane_batch.set_lane(l, Nearest_Points[plane_fit_index[k + l]]);
+                    plane_batch.pad();
+                    esti_plane_batch(plane_batch, 0.1f); //(planeValid)//判断点是否在平面上
+                    for (int l = 0; l < plane_batch.lanes; l++)
                     {
-                        float pd2 = pabcd(0) * point_world.x + pabcd(1) * point_world.y + pabcd(2) * point_world.z +
-                                    pabcd(3);//获得点到平面的距离
-                        float s = 1 - 0.9 * fabs(pd2) / sqrt(p_body.norm()); // fabs(pd2) / sqrt(p_body.norm())
-                        //s表示一个减小的权重因子。这个因子随着点到平面的距离增加而减小。点到平面的距离/点到此帧的距离的开方
-                        //                        normvec->resize(feats_down_size);
-                        if (s > 0.9)
-                        { // TODO: threshold 点到平面距离 < 1/9，则保留点用于平面，保留平面法向量
-                            point_selected_surf[i] = true;
-                            normvec->points[i].x = pabcd(0); // hr: save normvec
-                            normvec->points[i].y = pabcd(1);
-                            normvec->points[i].z = pabcd(2);
-                            normvec->points[i].intensity = pd2;
-                            res_last[i] = abs(pd2); // hr: save residuals//保存残差
-                        }
+                        if (!plane_batch.valid[l])
+                            continue;
+                        VF(4) pabcd;
+                        pabcd << plane_batch.pabcd[0][l], plane_batch.pabcd[1][l], plane_batch.pabcd[2][l], plane_batch.pabcd[3][l];
+                        point_selected_surf[plane_fit_index[k + l]] = plane_residual(plane_fit_index[k + l], pabcd);
                     }
                 }
                 // cout<<"pca time test: "<<pca_time1<<" "<<pca_time2<<endl;
@@ -1368,6 +2008,7 @@ int main(int argc, char **argv)
                     if (point_selected_surf[i] && (res_last[i] <= 2.0))//如果是面点且残差小于2
                     { // 如果点被选中且残差小于等于 2.0
                         laserCloudOri->points[effct_feat_num] = feats_down_body->points[i]; // 将点添加到有效特征点云中
+                        effct_index[effct_feat_num] = i;
                         corr_normvect->points[effct_feat_num] = normvec->points[i]; // 将对应的法向量添加到法向量点云中
                         total_residual += res_last[i]; // 累加残差
                         effct_feat_num++; // 有效特征点数量加 1
@@ -1385,27 +2026,54 @@ int main(int argc, char **argv)
                 solve_start = omp_get_wtime();               // 迭代求解开始
 
                 /*** Computation of Measuremnt Jacobian matrix H and measurents vector ***/
-                MatrixXd Hsub(effct_feat_num, 6);//H 海森矩阵
-                VectorXd meas_vec(effct_feat_num);// 测量向量
+                MD(6, 6) HTH_pose; //; H^T H的位姿块
+                VD(6) HTz;
+                if (lio_float_en)
+                {
+                    lio_jacobian_float(HTH_pose, HTz);
+                }
+                else
+                {
+                    MatrixXd Hsub(effct_feat_num, 6);//H 海森矩阵
+                    VectorXd meas_vec(effct_feat_num);// 测量向量
 
-                for (int i = 0; i < effct_feat_num; i++)//对于每一个有效点
+                    for (int i = 0; i < effct_feat_num; i++)//对于每一个有效点
+                    {
+                        const PointType &laser_p = laserCloudOri->points[i];
+                        V3D point_this(laser_p.x, laser_p.y, laser_p.z);
+                        point_this += Lidar_offset_to_IMU;//转到IMU坐标系下
+                        M3D point_crossmat;//反对称矩阵
+                        point_crossmat << SKEW_SYM_MATRX(point_this); // 反对称矩阵^,也是外积
+
+                        /*** get the normal vector of closest surface/corner ***/
+                        const PointType &norm_p = corr_normvect->points[i];
+                        V3D norm_vec(norm_p.x, norm_p.y, norm_p.z); // 法向量
+
+                        /*** calculate the Measuremnt Jacobian matrix H ***///计算测量雅可比矩阵
+                        V3D A(point_crossmat * state.rot_end.transpose() * norm_vec);//点到面残差的雅可比矩阵，公式推导见飞书
+                        Hsub.row(i) << VEC_FROM_ARRAY(A), norm_p.x, norm_p.y, norm_p.z;//将雅可比矩阵赋值给Hsub
+
+                        /*** Measuremnt: distance to the closest surface/corner ***/
+                        meas_vec(i) = -norm_p.intensity;//法向量点归一化的那个距禮，也就是点到面的距离
+                    }
+                    HTH_pose = Hsub.transpose() * Hsub;
+                    HTz = Hsub.transpose() * meas_vec;
+                    if (info_select_en && !info_selected)
+                    {
+                        for (int k = 0; k < 6; k++)
+                        {
+                            H_soa[k].resize(effct_feat_num);
+                            for (int i = 0; i < effct_feat_num; i++)
+                                H_soa[k][i] = Hsub(i, k);
+                        }
+                    }
+                }
+                info_eigen = SelfAdjointEigenSolver<MD(6, 6)>(HTH_pose, EigenvaluesOnly).eigenvalues();
+                //; 第一次迭代用全部的点，之后只匹配选出来的点
+                if (info_select_en && !info_selected && flg_EKF_inited && effct_feat_num > info_select_num)
                 {
-                    const PointType &laser_p = laserCloudOri->points[i];
-                    V3D point_this(laser_p.x, laser_p.y, laser_p.z);
-                    point_this += Lidar_offset_to_IMU;//转到IMU坐标系下
-                    M3D point_crossmat;//反对称矩阵
-                    point_crossmat << SKEW_SYM_MATRX(point_this); // 反对称矩阵^,也是外积
-
-                    /*** get the normal vector of closest surface/corner ***/
-                    const PointType &norm_p = corr_normvect->points[i];
-                    V3D norm_vec(norm_p.x, norm_p.y, norm_p.z); // 法向量
-
-                    /*** calculate the Measuremnt Jacobian matrix H ***///计算测量雅可比矩阵
-                    V3D A(point_crossmat * state.rot_end.transpose() * norm_vec);//点到面残差的雅可比矩阵，公式推导见飞书
-                    Hsub.row(i) << VEC_FROM_ARRAY(A), norm_p.x, norm_p.y, norm_p.z;//将雅可比矩阵赋值给Hsub
-
-                    /*** Measuremnt: distance to the closest surface/corner ***/
-                    meas_vec(i) = -norm_p.intensity;//法向量点归一化的那个距禮，也就是点到面的距离
+                    info_select(HTH_pose);
+                    info_selected = true;
                 }
                 solve_const_H_time += omp_get_wtime() - solve_start;
 
@@ -1435,27 +2103,15 @@ int main(int argc, char **argv)
                 }
                 else
                 {
-                    auto &&Hsub_T = Hsub.transpose();
-                    auto &&HTz = Hsub_T * meas_vec;
-                    H_T_H.block<6, 6>(0, 0) = Hsub_T * Hsub;
+                    H_T_H.block<6, 6>(0, 0) = HTH_pose;
                     // EigenSolver<Matrix<double, 6, 6>> es(H_T_H.block<6,6>(0,0));
                     // TODO:雷达协方差
-                    MD(DIM_STATE, DIM_STATE) &&K_1 =
-                        (H_T_H + (state.cov / LASER_POINT_COV).inverse()).inverse();
-                    G.block<DIM_STATE, 6>(0, 0) = K_1.block<DIM_STATE, 6>(0, 0) * H_T_H.block<6, 6>(0, 0);
+                    //; 只求 (H_T_H + (state.cov / LASER_POINT_COV).inverse()).inverse() 的前6列
+                    MD(DIM_STATE, 6) K_1;
+                    info_solver.solve(H_T_H.block<6, 6>(0, 0), K_1);
+                    G.block<DIM_STATE, 6>(0, 0) = K_1 * H_T_H.block<6, 6>(0, 0);
                     auto vec = state_propagat - state;
-                    solution = K_1.block<DIM_STATE, 6>(0, 0) * HTz + vec -
-                               G.block<DIM_STATE, 6>(0, 0) * vec.block<6, 1>(0, 0);
-
-                    //                    int minRow, minCol;
-                    if (0) //if(V.minCoeff(&minRow, &minCol) < 1.0f)
-                    {
-                        VD(6)
-                        V = H_T_H.block<6, 6>(0, 0).eigenvalues().real();
-                        cout << "!!!!!! Degeneration Happend, eigen values: " << V.transpose() << endl;
-                        EKF_stop_flg = true;
-                        solution.block<6, 1>(9, 0).setZero();
-                    }
+                    solution = K_1 * HTz + vec - G.block<DIM_STATE, 6>(0, 0) * vec.block<6, 1>(0, 0);
 
                     state += solution;
 
@@ -1512,6 +2168,23 @@ int main(int argc, char **argv)
 
         // SaveTrajTUM(LidarMeasures.lidar_beg_time, state.rot_end, state.pos_end);
         double t_update_end = omp_get_wtime();
+        //; 退化检测用最后一次迭代的信息矩阵特征值
+        bool degenerate = lidar_en && degeneracy_thresh > 0 && info_eigen(0) < degeneracy_thresh;
+        if (degenerate)
+            degenerate_frames++;
+        if (lidar_en && (debug || degenerate))
+            printf("[ LIO ]: information eigenvalues: %0.2f %0.2f %0.2f %0.2f %0.2f %0.2f, effective points %d%s%s\n", info_eigen(0),
+                   info_eigen(1), info_eigen(2), info_eigen(3), info_eigen(4), info_eigen(5), effct_feat_num,
+                   info_selected ? ", selected" : "", degenerate ? ", DEGENERATE" : "");
+        if (point_budget_en)
+        {
+            if (debug)
+                printf("[ LIO ]: point budget: leaf %0.3f, points %d -> %d, budget %d, LIO time %0.3f / %0.1f ms%s\n",
+                       point_budget.leaf_size(), feats_down_raw, feats_down_size, point_budget.budget(),
+                       (t_update_end - downsample_start) * 1e3, lio_deadline,
+                       t_update_end - downsample_start > lio_deadline * 1e-3 ? " MISS" : (budget_subset ? " subset" : ""));
+            point_budget.update(feats_down_raw, feats_down_size, t_update_end - downsample_start);
+        }
 
         double time_end = t_update_end;
         std::cout << "LIO time: " << (time_end - time_start) << std::endl;
@@ -1520,6 +2193,16 @@ int main(int argc, char **argv)
         euler_cur = RotMtoEuler(state.rot_end);//得到当前帧的欧拉角
         geoQuat = tf::createQuaternionMsgFromRollPitchYaw(euler_cur(0), euler_cur(1), euler_cur(2));//得到四元数
         publish_odometry(pubOdomAftMapped);//发布里程计到ROS
+        if (imu_odom_en)
+            imu_propagator.set_anchor(state, LidarMeasures.last_update_time, p_imu->get_acc_scale()); //; IMU频率的位姿从这里重新开始外推
+
+        //; fov_boxes和plane_cache会被异步插入线程修改，调试输出用的大小要在放锁之前取
+        int fov_box_num = fov_boxes.size(), planar_voxel_num = plane_cache.size();
+        if (map_lock.owns_lock())
+            map_lock.unlock();
+        if (map_insert_async_en && debug)
+            printf("[ LIO ]: map insert: staleness %d frames, wait %0.3f ms, insert %0.3f ms\n", map_inserter.staleness(),
+                   map_inserter.aver_wait_time * 1e3, map_inserter.aver_insert_time.load() * 1e3);
 
         /*** add the feature points to map kdtree ***/ //将刚才这帧特征点加入到地图的kdtree中
         t3 = omp_get_wtime();
@@ -1552,6 +2235,22 @@ int main(int argc, char **argv)
 
         aver_time_solve = aver_time_solve * (frame_num - 1) / frame_num + (solve_time) / frame_num;
         aver_time_const_H_time = aver_time_const_H_time * (frame_num - 1) / frame_num + solve_const_H_time / frame_num;
+        aver_time_incre = aver_time_incre * (frame_num - 1) / frame_num + kdtree_incremental_time / frame_num;
+        aver_time_downsample = aver_time_downsample * (frame_num - 1) / frame_num + downsample_time / frame_num;
+        aver_time_undistort = aver_time_undistort * (frame_num - 1) / frame_num + p_imu->undistort_time / frame_num;
+        if (kdtree_search_counter > 0)
+            aver_time_search = aver_time_search * (frame_num - 1) / frame_num + kdtree_search_time / kdtree_search_counter / frame_num;
+        if (fov_segment_en && debug)
+            printf("[ LIO ]: FOV boxes active: %d / %d, map size: %d\n", fov_active_box_num, fov_box_num,
+                   map_insert_async_en ? featsFromMapNum : lidar_map->size()); //; 异步插入时地图可能正在被修改
+        if (debug)
+            printf("[ LIO ]: preprocess time: %0.3f ms, scans: %d\n", p_pre->time_last.load() * 1e3, p_pre->scan_num.load());
+        if (debug)
+            printf("[ LIO ]: neighbour queries: %ld, reused: %ld, reuse rate: %0.3f\n", neighbour_query_num, neighbour_reuse_num,
+                   neighbour_query_num > 0 ? double(neighbour_reuse_num) / neighbour_query_num : 0.0);
+        if (plane_cache_en && debug)
+            printf("[ LIO ]: match time: %0.6f, plane cache hit rate: %0.3f, planar voxels: %d\n", match_time,
+                   plane_cache.query_num > 0 ? double(plane_cache.hit_num) / plane_cache.query_num : 0.0, planar_voxel_num);
         //cout << "construct H:" << aver_time_const_H_time << std::endl;
         // aver_time_consu = aver_time_consu * 0.9 + (t5 - t0) * 0.1;
         T1[time_log_counter] = LidarMeasures.lidar_beg_time;
@@ -1577,7 +2276,28 @@ int main(int argc, char **argv)
         }
         // dump_lio_state_to_log(fp);
     }
+    if (map_insert_async_en)
+        map_inserter.flush(); //; 保存地图和统计之前把没插完的帧插完
     //--------------------------save map---------------
+    if (!map_save_file.empty())
+    {
+        if (map_save_file[0] != '/')
+            map_save_file = root_dir + map_save_file;
+        double save_start = omp_get_wtime();
+        if (tile_store_en)
+        {
+            //; 写到磁盘的tile退出时会被删掉，保存前加回地图，快照才是完整的地图
+            PointVector tile_points;
+            tile_store.Collect(tile_points);
+            lidar_map->Add_Points(tile_points, false);
+            printf("[ mapping ]: merge %d tile points into the saved map\n", (int)tile_points.size());
+        }
+        if (lidar_map->save_snapshot(map_save_file, map_save_attributes))
+            printf("[ mapping ]: save map %s, %d points, %0.3f s\n", map_save_file.c_str(), lidar_map->size(),
+                   omp_get_wtime() - save_start);
+        else
+            ROS_WARN("Failed to save map %s", map_save_file.c_str());
+    }
     // string surf_filename(map_file_path + "/surf.pcd");
     // string corner_filename(map_file_path + "/corner.pcd");
     // string all_points_filename(map_file_path + "/all_points.pcd");
@@ -1613,6 +2333,43 @@ int main(int argc, char **argv)
         s_vec7.push_back(s_plot7[i]);
     }
     fclose(fp2);
+    printf("[ mapping ]: map backend: %s, frames: %d, average search time: %0.3f us, average incremental time: %0.3f ms, map size: %d\n",
+           lidar_map->name(), frame_num, aver_time_search * 1e6, aver_time_incre * 1e3, lidar_map->size());
+    printf("[ mapping ]: average match time: %0.3f ms, plane cache: %s, hit rate: %0.3f\n", aver_time_match * 1e3,
+           plane_cache_en ? "on" : "off", plane_cache.query_num > 0 ? double(plane_cache.hit_num) / plane_cache.query_num : 0.0);
+    printf("[ mapping ]: neighbour reuse ratio: %0.3f, reuse rate: %0.3f\n", neighbour_reuse_ratio,
+           neighbour_query_num > 0 ? double(neighbour_reuse_num) / neighbour_query_num : 0.0);
+    if (ingest_thread_en)
+        printf("[ mapping ]: ingest thread: %ld scans, dropped %ld on a full queue\n", scan_ingest.scan_num.load(),
+               scan_ingest.drop_num);
+    if (map_insert_async_en)
+        printf("[ mapping ]: async map insert: %ld frames, average insert time %0.3f ms, average wait %0.3f ms, "
+               "staleness average %0.2f / max %d frames (max lag %d)\n",
+               map_inserter.insert_num.load(), map_inserter.aver_insert_time.load() * 1e3, map_inserter.aver_wait_time * 1e3,
+               map_inserter.aver_stale, map_inserter.max_stale, map_insert_max_lag);
+    printf("[ mapping ]: task scheduler: %d threads, parallel loops %ld, chunks %ld, stolen %ld\n", task_scheduler.thread_num(),
+           task_scheduler.job_num.load(), task_scheduler.task_num.load(), task_scheduler.steal_num.load());
+    if (imu_odom_en)
+        printf("[ mapping ]: IMU-rate odometry: %ld poses published, average lag %0.3f ms\n", imu_propagator.published_num.load(),
+               imu_propagator.aver_lag.load() * 1e3);
+    if (tile_store_en)
+        printf("[ mapping ]: tile store: %d tiles on disk, points stored %ld, loaded %ld\n", tile_store.tile_num(),
+               tile_store.stored_num, tile_store.loaded_num);
+    if (fov_segment_en)
+        printf("[ mapping ]: FOV segment: active boxes %d / %d, stashed boxes %d\n", fov_active_box_num, int(fov_boxes.size()),
+               int(fov_box_stash.size()));
+    printf("[ mapping ]: average preprocess time: %0.3f ms over %d scans, feature extraction: %s\n", p_pre->time_aver.load() * 1e3,
+           p_pre->scan_num.load(), p_pre->feature_enabled ? "on" : "off");
+    printf("[ mapping ]: average undistort time: %0.3f ms, mode: %s\n", aver_time_undistort * 1e3,
+           undistort_mode == UNDISTORT_EXACT ? "exact" : "approx");
+    printf("[ mapping ]: average downsample time: %0.3f ms, mode: %s\n", aver_time_downsample * 1e3,
+           downsample_mode == VOXEL_NEAREST ? "nearest" : "centroid");
+    printf("[ mapping ]: information selection: %s, selected frames %ld, degenerate frames %ld (threshold %0.2f)\n",
+           info_select_en ? "on" : "off", info_select_frames, degenerate_frames, degeneracy_thresh);
+    if (point_budget_en)
+        printf("[ mapping ]: point budget: deadline %0.1f ms, missed %d / %d frames, subset frames %d, average leaf %0.3f, cost per point %0.3f us\n",
+               lio_deadline, point_budget.miss_num, point_budget.frame_num, point_budget.subset_num, point_budget.leaf_aver,
+               point_budget.cost_per_point * 1e6);
     if (!t.empty())
     {
         // plt::named_plot("incremental time",t,s_vec2);
@@ -1074,16 +1074,16 @@ namespace lidar_selection
 
                 auto &&H_sub_T = H_sub.transpose();  //; 6*n
                 H_T_H.block<6, 6>(0, 0) = H_sub_T * H_sub;
-                MD(DIM_STATE, DIM_STATE) &&K_1 = (H_T_H +
-                                                  (state->cov / img_point_cov).inverse())
-                                                     .inverse(); // TODO：视觉协方差
+                //; 只求 (H_T_H + (state->cov / img_point_cov).inverse()).inverse() 的前6列
+                MD(DIM_STATE, 6) K_1;
+                info_solver.solve(H_T_H.block<6, 6>(0, 0), K_1); // TODO：视觉协方差
                 auto &&HTz = H_sub_T * z;  //; 6*n x n*1 = 6*1
                 // K = K_1.block<DIM_STATE,6>(0,0) * H_sub_T;
                 //; state_propagat 就是IMU预测的状态，而state是当前状态，所以vec就是状态的误差，这个就是IEKF的公式
                 auto vec = (*state_propagat) - (*state);
-                G.block<DIM_STATE, 6>(0, 0) = K_1.block<DIM_STATE, 6>(0, 0) * H_T_H.block<6, 6>(0, 0);
+                G.block<DIM_STATE, 6>(0, 0) = K_1 * H_T_H.block<6, 6>(0, 0);
                 //! 疑问：感觉这里多了一项vec? 应该是没有vec的吧？
-                auto solution = -K_1.block<DIM_STATE, 6>(0, 0) * HTz + vec -
+                auto solution = -K_1 * HTz + vec -
                                 G.block<DIM_STATE, 6>(0, 0) * vec.block<6, 1>(0, 0);
                 (*state) += solution;
                 auto &&rot_add = solution.block<3, 1>(0, 0);
@@ -1201,6 +1201,7 @@ namespace lidar_selection
         float now_error = error;
 
         // Step :视觉优化的主函数！三次循环，coarse-to-fine的三次优化
+        info_solver.set_prior(state->cov, img_point_cov); //; 三层金字塔的迭代中state->cov不变，只分解一次
         for (int level = 2; level >= 0; level--)
         { // hr: a coarse-to-fine manner 2->0:粗糙->精细
             now_error = UpdateState(img, error, level);//三层直接法金字塔优化
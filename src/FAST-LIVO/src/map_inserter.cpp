@@ -0,0 +1,102 @@
+#include "map_inserter.h"
+#include <omp.h>
+
+MapInserter::MapInserter()
+{
+    running = false;
+    submit_num = 0;
+    insert_num = 0;
+    acquire_num = 0;
+    stale_last = 0;
+    max_stale = 0;
+    aver_insert_time = 0;
+    aver_wait_time = 0;
+    aver_stale = 0;
+}
+
+MapInserter::~MapInserter()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    sig.notify_all();
+    worker.join();
+}
+
+void MapInserter::init(const Apply &apply_param)
+{
+    apply = apply_param;
+    running = true;
+    worker = std::thread(&MapInserter::run, this);
+}
+
+void MapInserter::submit(PointVector &points)
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.emplace_back();
+        tasks.back().swap(points);
+        submit_num++;
+    }
+    sig.notify_one();
+}
+
+std::unique_lock<std::mutex> MapInserter::acquire(int max_lag)
+{
+    double wait_start = omp_get_wtime();
+    {
+        std::unique_lock<std::mutex> lock(mtx);
+        done.wait(lock, [this, max_lag] { return submit_num - insert_num <= max(max_lag, 0); });
+    }
+    std::unique_lock<std::mutex> map_lock(map_mtx);
+    {
+        //; 拿到地图锁以后后台线程不会再插入，这时候没插完的帧就是这一帧看不到的
+        std::lock_guard<std::mutex> lock(mtx);
+        stale_last = submit_num - insert_num;
+    }
+    acquire_num++;
+    max_stale = max(max_stale, stale_last);
+    aver_stale = aver_stale * (acquire_num - 1) / acquire_num + double(stale_last) / acquire_num;
+    aver_wait_time = aver_wait_time * (acquire_num - 1) / acquire_num + (omp_get_wtime() - wait_start) / acquire_num;
+    return map_lock;
+}
+
+void MapInserter::flush()
+{
+    std::unique_lock<std::mutex> lock(mtx);
+    done.wait(lock, [this] { return submit_num == insert_num; });
+}
+
+void MapInserter::run()
+{
+    while (true)
+    {
+        PointVector points;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            sig.wait(lock, [this] { return !running || !tasks.empty(); });
+            if (!running && tasks.empty())
+                return;
+            points.swap(tasks.front());
+            tasks.pop_front();
+        }
+        //; 一次只插一帧，按提交顺序插入
+        double insert_start = omp_get_wtime();
+        {
+            std::lock_guard<std::mutex> map_lock(map_mtx);
+            apply(points);
+        }
+        double insert_time = omp_get_wtime() - insert_start;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            long num = ++insert_num;
+            aver_insert_time = aver_insert_time * (num - 1) / num + insert_time / num;
+        }
+        done.notify_all();
+    }
+}
@@ -0,0 +1,149 @@
+#include "plane_cache.h"
+
+PlaneCache::PlaneCache()
+{
+    set_param(1.0, 10, 0.03);
+    reset_counter();
+}
+
+void PlaneCache::set_param(double voxel_size_param, int min_points_param, double max_thickness_param)
+{
+    voxel_size = voxel_size_param;
+    inv_voxel_size = 1.0 / voxel_size;
+    min_points = min_points_param;
+    max_thickness = max_thickness_param;
+}
+
+void PlaneCache::reset_counter()
+{
+    query_num = 0;
+    hit_num = 0;
+}
+
+VOXEL_KEY PlaneCache::key_of(float x, float y, float z) const
+{
+    return VOXEL_KEY(floor(x * inv_voxel_size), floor(y * inv_voxel_size), floor(z * inv_voxel_size));
+}
+
+void PlaneCache::Update(const PointVector &points_world)
+{
+    for (int i = 0; i < points_world.size(); i++)
+    {
+        const PointType &p = points_world[i];
+        PlaneVoxel &v = voxels[key_of(p.x, p.y, p.z)];
+        V3D pt(p.x, p.y, p.z);
+        v.n++;
+        v.sum += pt;
+        v.sum_sq += pt * pt.transpose();
+        v.dirty = true;
+    }
+}
+
+//; 降采样替换掉的点要从统计量里减掉，点全减完的体素直接删掉
+void PlaneCache::Remove(const PointVector &points_world)
+{
+    for (int i = 0; i < points_world.size(); i++)
+    {
+        const PointType &p = points_world[i];
+        auto iter = voxels.find(key_of(p.x, p.y, p.z));
+        if (iter == voxels.end())
+            continue;
+        PlaneVoxel &v = iter->second;
+        V3D pt(p.x, p.y, p.z);
+        v.n--;
+        v.sum -= pt;
+        v.sum_sq -= pt * pt.transpose();
+        v.dirty = true;
+        if (v.n <= 0)
+            voxels.erase(iter);
+    }
+}
+
+//; 协方差的最小特征值对应法向量，厚度足够小并且平面内两个方向都展开了才认为是可信的平面
+void PlaneCache::fit(PlaneVoxel &v)
+{
+    v.dirty = false;
+    v.is_plane = false;
+    if (v.n < min_points)
+        return;
+    V3D center = v.sum / v.n;
+    M3D cov = v.sum_sq / v.n - center * center.transpose();
+    SelfAdjointEigenSolver<M3D> es(cov);
+    V3D eig = es.eigenvalues(); // 从小到大
+    if (eig(0) < 0 || sqrt(eig(0)) > max_thickness || eig(1) < 25 * eig(0))
+        return;
+    V3D normal = es.eigenvectors().col(0);
+    double d = -normal.dot(center);
+    if (d < 0)
+    {
+        normal = -normal;
+        d = -d;
+    }
+    v.plane << normal.cast<float>(), float(d);
+    v.is_plane = true;
+}
+
+bool PlaneCache::Query(const PointType &point_world, VF(4) & pabcd)
+{
+    query_num++;
+    auto iter = voxels.find(key_of(point_world.x, point_world.y, point_world.z));
+    if (iter == voxels.end())
+        return false;
+    PlaneVoxel &v = iter->second;
+    if (v.dirty)
+        fit(v);
+    if (!v.is_plane)
+        return false;
+    pabcd = v.plane;
+    hit_num++;
+    return true;
+}
+
+//; 体素中心在盒子内就算属于这个盒子，Delete_Boxes和Rebuild_Box用同一个判断
+bool PlaneCache::center_in_box(const VOXEL_KEY &key, const BoxPointType &box) const
+{
+    V3D center = (V3D(key.x, key.y, key.z) + V3D(0.5, 0.5, 0.5)) * voxel_size;
+    for (int j = 0; j < 3; j++)
+    {
+        if (center(j) < box.vertex_min[j] || center(j) > box.vertex_max[j])
+            return false;
+    }
+    return true;
+}
+
+void PlaneCache::Delete_Boxes(const vector<BoxPointType> &boxes)
+{
+    if (boxes.empty())
+        return;
+    for (auto iter = voxels.begin(); iter != voxels.end();)
+    {
+        bool inside = false;
+        for (int i = 0; i < boxes.size() && !inside; i++)
+            inside = center_in_box(iter->first, boxes[i]);
+        if (inside)
+            iter = voxels.erase(iter);
+        else
+            ++iter;
+    }
+}
+
+//; 盒子里的点重新回到地图: 先清掉盒子里的体素，再用地图里现有的点重新统计
+//; points_world要覆盖中心在盒子内的体素的全部点，体素外的点会被忽略
+void PlaneCache::Rebuild_Box(const BoxPointType &box, const PointVector &points_world)
+{
+    vector<BoxPointType> boxes(1, box);
+    Delete_Boxes(boxes);
+    for (int i = 0; i < points_world.size(); i++)
+    {
+        const PointType &p = points_world[i];
+        VOXEL_KEY key = key_of(p.x, p.y, p.z);
+        if (!center_in_box(key, box))
+            continue;
+        PlaneVoxel &v = voxels[key];
+        V3D pt(p.x, p.y, p.z);
+        v.n++;
+        v.sum += pt;
+        v.sum_sq += pt * pt.transpose();
+        v.dirty = true;
+    }
+}
@@ -0,0 +1,119 @@
+#include "point_budget.h"
+#include <climits>
+
+#define BUDGET_HEADROOM (0.85) //; 分辨率按budget的这个比例来调，给当前帧的选点留余量
+#define BUDGET_MIN_POINTS (200) //; budget再小也至少保留这么多点，保证位姿可观
+#define COST_SMOOTH (0.2)       //; 每点耗时的滑动平均系数
+
+PointBudget::PointBudget()
+{
+    deadline = 0.05;
+    leaf = leaf_min = 0.5;
+    leaf_max = 2.0;
+    frame_num = 0;
+    miss_num = 0;
+    subset_num = 0;
+    cost_per_point = 0;
+    leaf_aver = 0;
+    bins.resize(BUDGET_BIN_AZI * BUDGET_BIN_ELE);
+}
+
+void PointBudget::init(double deadline_param, double leaf_min_param, double leaf_max_param)
+{
+    deadline = deadline_param;
+    leaf_min = leaf_min_param;
+    leaf_max = max(leaf_min_param, leaf_max_param);
+    leaf = leaf_min;
+}
+
+int PointBudget::budget() const
+{
+    if (cost_per_point <= 0)
+        return INT_MAX; //; 还没有测到耗时
+    return max(BUDGET_MIN_POINTS, int(deadline / cost_per_point));
+}
+
+bool PointBudget::select(PointCloudXYZI &points)
+{
+    const int size = points.size();
+    const int target = budget();
+    if (size <= target)
+        return false;
+
+    // Step 1: 在点云实际的视场范围内按方位角和俯仰角划分网格
+    azi.resize(size);
+    ele.resize(size);
+    range.resize(size);
+    float azi_min = INFINITY, azi_max = -INFINITY, ele_min = INFINITY, ele_max = -INFINITY;
+    for (int i = 0; i < size; i++)
+    {
+        const PointType &p = points.points[i];
+        float xy = sqrt(p.x * p.x + p.y * p.y);
+        azi[i] = atan2(p.y, p.x);
+        ele[i] = atan2(p.z, xy);
+        range[i] = sqrt(xy * xy + p.z * p.z);
+        azi_min = min(azi_min, azi[i]);
+        azi_max = max(azi_max, azi[i]);
+        ele_min = min(ele_min, ele[i]);
+        ele_max = max(ele_max, ele[i]);
+    }
+    float azi_scale = BUDGET_BIN_AZI / max(azi_max - azi_min, 1e-6f);
+    float ele_scale = BUDGET_BIN_ELE / max(ele_max - ele_min, 1e-6f);
+    for (int b = 0; b < bins.size(); b++)
+        bins[b].clear();
+    for (int i = 0; i < size; i++)
+    {
+        int a = min(BUDGET_BIN_AZI - 1, int((azi[i] - azi_min) * azi_scale));
+        int e = min(BUDGET_BIN_ELE - 1, int((ele[i] - ele_min) * ele_scale));
+        bins[e * BUDGET_BIN_AZI + a].push_back(i);
+    }
+
+    // Step 2: 注水法分配名额，点少的方向全部保留，剩下的名额平分给点多的方向
+    vector<int> order(bins.size());
+    for (int b = 0; b < order.size(); b++)
+        order[b] = b;
+    sort(order.begin(), order.end(), [this](int l, int r) { return bins[l].size() < bins[r].size(); });
+    keep.assign(size, false);
+    int remaining = target;
+    for (int k = 0; k < order.size(); k++)
+    {
+        vector<int> &bin = bins[order[k]];
+        int quota = remaining / (order.size() - k);
+        int take = min(int(bin.size()), quota);
+        remaining -= take;
+        if (take == 0)
+            continue;
+        //; 方格内按距离排序后等间隔抽取，近处的点约束平移，远处的点约束旋转，都保留一部分
+        sort(bin.begin(), bin.end(), [this](int l, int r) { return range[l] < range[r]; });
+        for (int j = 0; j < take; j++)
+            keep[bin[(long(j) * bin.size()) / take]] = true;
+    }
+
+    // Step 3: 按原来的顺序压缩
+    int n = 0;
+    for (int i = 0; i < size; i++)
+    {
+        if (keep[i])
+            points.points[n++] = points.points[i];
+    }
+    points.resize(n);
+    subset_num++;
+    return true;
+}
+
+void PointBudget::update(int down_num, int used_num, double lio_time)
+{
+    frame_num++;
+    if (lio_time > deadline)
+        miss_num++;
+    leaf_aver = leaf_aver * (frame_num - 1) / frame_num + leaf / frame_num;
+    if (used_num <= 0 || down_num <= 0)
+        return;
+    double cost = lio_time / used_num;
+    cost_per_point = cost_per_point <= 0 ? cost : (1 - COST_SMOOTH) * cost_per_point + COST_SMOOTH * cost;
+
+    //; 扫描到的基本是面，下采样后的点数约和分辨率的平方成反比；和当前分辨率取几何平均，避免来回振荡
+    double target = BUDGET_HEADROOM * deadline / cost_per_point;
+    double leaf_new = leaf * sqrt(down_num / target);
+    leaf = max(leaf_min, min(leaf_max, sqrt(leaf * leaf_new)));
+}
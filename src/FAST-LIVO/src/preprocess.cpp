@@ -1,11 +1,13 @@
 #include "preprocess.h"
+#include <omp.h>
 
 #define RETURN0 0x00
 #define RETURN0AND1 0x10
 //从不同类型的激光雷达中获取点云数据，并根据需要进行预处理和特征提取。
 //这部分应该是属于fast-lio系列中的代码
 Preprocess::Preprocess()
-    : feature_enabled(0), lidar_type(AVIA), blind(0.01), point_filter_num(1)
+    : feature_enabled(0), lidar_type(AVIA), blind(0.01), point_filter_num(1), time_last(0), time_aver(0), scan_num(0),
+      scheduler(nullptr), task_priority(TASK_CRITICAL)
 {
     inf_bound = 10;
     N_SCANS = 6;
@@ -42,12 +44,15 @@ void Preprocess::set(bool feat_en, int lid_type, double bld, int pfilt_num)
 
 void Preprocess::process(const livox_ros_driver::CustomMsg::ConstPtr &msg, PointCloudXYZI::Ptr &pcl_out)
 {
+    double t0 = omp_get_wtime();
     avia_handler(msg);
-    *pcl_out = pl_surf;
+    time_sort(pl_surf, *pcl_out);
+    record_time(omp_get_wtime() - t0);
 }
 
 void Preprocess::process(const sensor_msgs::PointCloud2::ConstPtr &msg, PointCloudXYZI::Ptr &pcl_out)
 {
+    double t0 = omp_get_wtime();
     switch (lidar_type)
     {
     case OUST64:
@@ -62,7 +67,63 @@ void Preprocess::process(const sensor_msgs::PointCloud2::ConstPtr &msg, PointClo
         printf("Error LiDAR Type");
         break;
     }
-    *pcl_out = pl_surf;
+    time_sort(pl_surf, *pcl_out);
+    record_time(omp_get_wtime() - t0);
+}
+
+/**
+ * @brief 按点的时间(curvature)排序，输出到out，后面sync_packages和IMU去畸变就不用再排序了
+ *        非负float的位模式和数值同序，对位模式做LSD基数排序就是精确的时间顺序；负数翻转全部位
+ *        排序的是(key, 下标)数组，最后按下标把点搬到out里，点本身只搬一次
+ */
+void Preprocess::time_sort(const PointCloudXYZI &pl, PointCloudXYZI &out)
+{
+    const int n = pl.size();
+    out.header = pl.header;
+    sort_items.resize(n);
+    bool sorted = true;
+    uint32_t last_key = 0;
+    for (int i = 0; i < n; i++)
+    {
+        uint32_t bits;
+        memcpy(&bits, &pl.points[i].curvature, sizeof(bits));
+        uint32_t key = bits ^ ((bits >> 31) ? 0xFFFFFFFFu : 0x80000000u);
+        sorted &= key >= last_key;
+        last_key = key;
+        sort_items[i] = (uint64_t(key) << 32) | uint32_t(i);
+    }
+    if (sorted)
+    {
+        out.points.assign(pl.points.begin(), pl.points.end());
+        out.width = n;
+        out.height = 1;
+        return;
+    }
+
+    sort_tmp.resize(n);
+    for (int shift = 32; shift < 64; shift += 8)
+    {
+        uint32_t count[257] = {0};
+        for (int i = 0; i < n; i++)
+            count[((sort_items[i] >> shift) & 0xFF) + 1]++;
+        if (count[((sort_items[0] >> shift) & 0xFF) + 1] == n)
+            continue; //; 这一字节所有点都一样，跳过
+        for (int b = 0; b < 256; b++)
+            count[b + 1] += count[b];
+        for (int i = 0; i < n; i++)
+            sort_tmp[count[(sort_items[i] >> shift) & 0xFF]++] = sort_items[i];
+        sort_items.swap(sort_tmp);
+    }
+    out.resize(n);
+    for (int i = 0; i < n; i++)
+        out.points[i] = pl.points[uint32_t(sort_items[i])];
+}
+
+void Preprocess::record_time(double t)
+{
+    int num = ++scan_num;
+    time_last = t;
+    time_aver = time_aver * (num - 1) / num + t / num;
 }
 
 void Preprocess::avia_handler(const livox_ros_driver::CustomMsg::ConstPtr &msg)
@@ -70,83 +131,98 @@ void Preprocess::avia_handler(const livox_ros_driver::CustomMsg::ConstPtr &msg)
     pl_surf.clear();
     pl_corn.clear();
     pl_full.clear();
-    double t1 = omp_get_wtime();
     uint plsize = msg->point_num;
-    uint effect_ind = 0;
 
-    pl_corn.reserve(plsize);
-    pl_surf.reserve(plsize);
-    pl_full.resize(plsize);
-
-    for (int i = 0; i < N_SCANS; i++)
+    //; 无分支的过滤+压缩: 每个点都写到输出的第n个位置，只有保留的点才让n前进，不会按原始下标稀疏地写
+    //; 不提特征时point_filter_num的抽稀也在这一遍里做，提特征时先把有效点压缩到pl_full再按line分
+    PointCloudXYZI &pl_out = feature_enabled ? pl_full : pl_surf;
+    const int filter_num = feature_enabled ? 1 : point_filter_num;
+    const livox_ros_driver::CustomPoint *pts = msg->points.data();
+    pl_out.resize(plsize);
+    pl_line.resize(plsize);
+    PointType *out = pl_out.points.data();
+    uint n = 0;
+    int effect_ind = 0;
+    for (uint i = 1; i < plsize; i++)
     {
-        pl_buff[i].clear();
-        pl_buff[i].reserve(plsize);
+        const livox_ros_driver::CustomPoint &p = pts[i];
+        const livox_ros_driver::CustomPoint &q = pts[i - 1];
+        bool valid = (abs(p.x - q.x) >= 1e-8) & (abs(p.y - q.y) >= 1e-8) & (abs(p.z - q.z) >= 1e-8) &
+                     (p.x * p.x + p.y * p.y >= blind) & (p.line <= N_SCANS) & ((p.tag & 0x30) == RETURN0AND1);
+        effect_ind += valid;
+        bool take = valid & (effect_ind == filter_num);
+        effect_ind = take ? 0 : effect_ind;
+
+        PointType &o = out[n];
+        o.x = p.x;
+        o.y = p.y;
+        o.z = p.z;
+        o.intensity = p.reflectivity;
+        o.curvature = p.offset_time / float(1000000); //use curvature as time of each laser points
+        pl_line[n] = p.line;
+        n += take;
     }
+    pl_out.resize(n);
 
     if (feature_enabled)
     {
-        for (uint i = 1; i < plsize; i++)
+        for (int i = 0; i < N_SCANS; i++)
         {
-            if ((abs(msg->points[i].x - msg->points[i - 1].x) < 1e-8) || (abs(msg->points[i].y - msg->points[i - 1].y) < 1e-8) || (abs(msg->points[i].z - msg->points[i - 1].z) < 1e-8) || (msg->points[i].x * msg->points[i].x + msg->points[i].y * msg->points[i].y < blind) || (msg->points[i].line > N_SCANS) || ((msg->points[i].tag & 0x30) != RETURN0AND1))
-            {
-                continue;
-            }
-
-            pl_full[i].x = msg->points[i].x;
-            pl_full[i].y = msg->points[i].y;
-            pl_full[i].z = msg->points[i].z;
-            pl_full[i].intensity = msg->points[i].reflectivity;
-            pl_full[i].curvature = msg->points[i].offset_time / float(1000000); //use curvature as time of each laser points
-            pl_buff[msg->points[i].line].push_back(pl_full[i]);
+            pl_buff[i].clear();
         }
-
-        for (int j = 0; j < N_SCANS; j++)
+        for (uint i = 0; i < n; i++)
         {
-            // printf("pl_buff[j].size(): %d \n", pl_buff[j].size());
-            if (pl_buff[j].size() <= 5)
-                continue;
-            pcl::PointCloud<PointType> &pl = pl_buff[j];
-            plsize = pl.size();
-            vector<orgtype> &types = typess[j];
-            types.clear();
-            types.resize(plsize);
-            plsize--;
-            for (uint i = 0; i < plsize; i++)
-            {
-                types[i].range = pl[i].x * pl[i].x + pl[i].y * pl[i].y;
-                vx = pl[i].x - pl[i + 1].x;
-                vy = pl[i].y - pl[i + 1].y;
-                vz = pl[i].z - pl[i + 1].z;
-                types[i].dista = vx * vx + vy * vy + vz * vz;
-            }
-            types[plsize].range = pl[plsize].x * pl[plsize].x + pl[plsize].y * pl[plsize].y;
-            give_feature(pl, types);
+            pl_buff[pl_line[i]].push_back(pl_full[i]);
         }
+        extract_lines(false, 6);
     }
-    else
-    {
-        for (uint i = 1; i < plsize; i++)
-        {
-            if ((abs(msg->points[i].x - msg->points[i - 1].x) < 1e-8) || (abs(msg->points[i].y - msg->points[i - 1].y) < 1e-8) || (abs(msg->points[i].z - msg->points[i - 1].z) < 1e-8) || (msg->points[i].x * msg->points[i].x + msg->points[i].y * msg->points[i].y < blind) || (msg->points[i].line > N_SCANS) || ((msg->points[i].tag & 0x30) != RETURN0AND1))
-            {
-                continue;
-            }
+}
 
-            effect_ind++;
+/**
+ * @brief 解析PointCloud2的字段偏移，布局和上一帧一样时直接用缓存
+ *
+ * @return 没有x/y/z字段时返回false
+ */
+bool Preprocess::resolve_layout(const sensor_msgs::PointCloud2 &msg)
+{
+    PointCloud2Layout &lay = cloud_layout;
+    bool same = lay.point_step == msg.point_step && lay.fields.size() == msg.fields.size();
+    for (int k = 0; same && k < msg.fields.size(); k++)
+    {
+        same = lay.fields[k].name == msg.fields[k].name && lay.fields[k].offset == msg.fields[k].offset &&
+               lay.fields[k].datatype == msg.fields[k].datatype;
+    }
+    if (same)
+        return lay.offset[F_X] >= 0;
 
-            if (effect_ind % point_filter_num == 0)
+    static const char *names[F_NUM] = {"x", "y", "z", "intensity", "t", "ring"};
+    lay.point_step = msg.point_step;
+    lay.fields = msg.fields;
+    for (int f = 0; f < F_NUM; f++)
+    {
+        lay.offset[f] = -1;
+        lay.type[f] = 0;
+        for (int k = 0; k < msg.fields.size(); k++)
+        {
+            if (msg.fields[k].name == names[f])
             {
-                pl_full[i].x = msg->points[i].x;
-                pl_full[i].y = msg->points[i].y;
-                pl_full[i].z = msg->points[i].z;
-                pl_full[i].intensity = msg->points[i].reflectivity;
-                pl_full[i].curvature = msg->points[i].offset_time / float(1000000); //use curvature as time of each laser points
-                pl_surf.push_back(pl_full[i]);
+                lay.offset[f] = msg.fields[k].offset;
+                lay.type[f] = msg.fields[k].datatype;
+                break;
             }
         }
     }
-    // printf("feature extraction time: %lf \n", omp_get_wtime()-t1);
+    if (lay.offset[F_X] < 0 || lay.offset[F_Y] < 0 || lay.offset[F_Z] < 0)
+    {
+        printf("[ Preprocess ]: PointCloud2 without x/y/z fields\n");
+        lay.offset[F_X] = -1;
+        return false;
+    }
+    if (msg.is_bigendian)
+        printf("[ Preprocess ]: big endian PointCloud2 is not supported\n");
+    if (lay.offset[F_RING] < 0)
+        printf("[ Preprocess ]: PointCloud2 without ring field, all points go to line 0\n");
+    return true;
 }
 
 void Preprocess::oust64_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
@@ -154,8 +230,9 @@ void Preprocess::oust64_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
     pl_surf.clear();
     pl_corn.clear();
     pl_full.clear();
-    pcl::PointCloud<ouster_ros::Point> pl_orig;
-    pcl::fromROSMsg(*msg, pl_orig);
+    if (!resolve_layout(*msg))
+        return;
+    PointCloud2View pl_orig(*msg, cloud_layout);
     uint plsize = pl_orig.size();
     pl_corn.reserve(plsize);
     pl_surf.reserve(plsize);
@@ -164,82 +241,53 @@ void Preprocess::oust64_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
         for (int i = 0; i < N_SCANS; i++)
         {
             pl_buff[i].clear();
-            pl_buff[i].reserve(plsize);
         }
 
+        //; 一遍读字段+过滤，每个字段只读一次
         for (uint i = 0; i < plsize; i++)
         {
-            double range = pl_orig.points[i].x * pl_orig.points[i].x + pl_orig.points[i].y * pl_orig.points[i].y + pl_orig.points[i].z * pl_orig.points[i].z;
+            PointType added_pt;
+            added_pt.x = pl_orig.x(i);
+            added_pt.y = pl_orig.y(i);
+            added_pt.z = pl_orig.z(i);
+            double range = added_pt.x * added_pt.x + added_pt.y * added_pt.y + added_pt.z * added_pt.z;
             if (range < blind)
                 continue;
-            Eigen::Vector3d pt_vec;
-            PointType added_pt;
-            added_pt.x = pl_orig.points[i].x;
-            added_pt.y = pl_orig.points[i].y;
-            added_pt.z = pl_orig.points[i].z;
-            added_pt.intensity = pl_orig.points[i].intensity;
+            int ring = pl_orig.ring(i);
+            if (ring >= N_SCANS)
+                continue;
+            added_pt.intensity = pl_orig.intensity(i);
             added_pt.normal_x = 0;
             added_pt.normal_y = 0;
             added_pt.normal_z = 0;
-            double yaw_angle = atan2(added_pt.y, added_pt.x) * 57.3;
-            if (yaw_angle >= 180.0)
-                yaw_angle -= 360.0;
-            if (yaw_angle <= -180.0)
-                yaw_angle += 360.0;
-
-            added_pt.curvature = pl_orig.points[i].t / 1e6;
-            if (pl_orig.points[i].ring < N_SCANS)
-            {
-                pl_buff[pl_orig.points[i].ring].push_back(added_pt);
-            }
+            added_pt.curvature = pl_orig.t(i) / 1e6;
+            pl_buff[ring].push_back(added_pt);
         }
 
-        for (int j = 0; j < N_SCANS; j++)
-        {
-            PointCloudXYZI &pl = pl_buff[j];
-            uint linesize = pl.size();
-            vector<orgtype> &types = typess[j];
-            types.clear();
-            types.resize(linesize);
-            linesize--;
-            for (uint i = 0; i < linesize; i++)
-            {
-                types[i].range = sqrt(pl[i].x * pl[i].x + pl[i].y * pl[i].y);
-                vx = pl[i].x - pl[i + 1].x;
-                vy = pl[i].y - pl[i + 1].y;
-                vz = pl[i].z - pl[i + 1].z;
-                types[i].dista = vx * vx + vy * vy + vz * vz;
-            }
-            types[linesize].range = sqrt(pl[linesize].x * pl[linesize].x + pl[linesize].y * pl[linesize].y);
-            give_feature(pl, types);
-        }
+        extract_lines(true, 1);
     }
     else
     {
         double time_stamp = msg->header.stamp.toSec();
         // cout << "===================================" << endl;
         // printf("Pt size = %d, N_SCANS = %d\r\n", plsize, N_SCANS);
-        for (int i = 0; i < pl_orig.points.size(); i++)
+        for (int i = 0; i < plsize; i += point_filter_num)
         {
-            if (i % point_filter_num != 0)
-                continue;
-
-            double range = pl_orig.points[i].x * pl_orig.points[i].x + pl_orig.points[i].y * pl_orig.points[i].y + pl_orig.points[i].z * pl_orig.points[i].z;
+            PointType added_pt;
+            added_pt.x = pl_orig.x(i);
+            added_pt.y = pl_orig.y(i);
+            added_pt.z = pl_orig.z(i);
+            double range = added_pt.x * added_pt.x + added_pt.y * added_pt.y + added_pt.z * added_pt.z;
 
             if (range < blind)
                 continue;
 
-            Eigen::Vector3d pt_vec;
-            PointType added_pt;
-            added_pt.x = pl_orig.points[i].x;
-            added_pt.y = pl_orig.points[i].y;
-            added_pt.z = pl_orig.points[i].z;
-            added_pt.intensity = pl_orig.points[i].intensity;
+            added_pt.intensity = pl_orig.intensity(i);
             added_pt.normal_x = 0;
             added_pt.normal_y = 0;
             added_pt.normal_z = 0;
 
-            added_pt.curvature = pl_orig.points[i].t / 1e6;
+            added_pt.curvature = pl_orig.t(i) / 1e6;
 
             // cout<<"added_pt.curvature: "<<added_pt.curvature<<endl;
             pl_surf.points.push_back(added_pt);
@@ -255,9 +303,12 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
     pl_corn.clear();
     pl_full.clear();
 
-    pcl::PointCloud<velodyne_ros::Point> pl_orig;
-    pcl::fromROSMsg(*msg, pl_orig);
-    uint plsize = pl_orig.points.size();
+    if (!resolve_layout(*msg))
+        return;
+    PointCloud2View pl_orig(*msg, cloud_layout);
+    uint plsize = pl_orig.size();
+    if (plsize == 0)
+        return;
     pl_surf.reserve(plsize);
 
     bool is_first[16];
@@ -270,14 +321,14 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
     float time_jump[16] = {0.0}; // offset time before jump
     memset(is_first, true, sizeof(is_first));
 
-    double yaw_first = atan2(pl_orig.points[0].y, pl_orig.points[0].x) * 57.29578;
+    double yaw_first = atan2(pl_orig.y(0), pl_orig.x(0)) * 57.29578;
     double yaw_end = yaw_first;
-    int layer_first = pl_orig.points[0].ring;
+    int layer_first = pl_orig.ring(0);
     for (uint i = plsize - 1; i > 0; i--)
     {
-        if (pl_orig.points[i].ring == layer_first)
+        if (pl_orig.ring(i) == layer_first)
         {
-            yaw_end = atan2(pl_orig.points[i].y, pl_orig.points[i].x) * 57.29578;
+            yaw_end = atan2(pl_orig.y(i), pl_orig.x(i)) * 57.29578;
             break;
         }
     }
@@ -293,7 +344,6 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
         for (int i = 0; i < N_SCANS; i++)
         {
             pl_buff[i].clear();
-            pl_buff[i].reserve(plsize);
         }
 
         for (int i = 0; i < plsize; i++)
@@ -302,13 +352,13 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
             added_pt.normal_x = 0;
             added_pt.normal_y = 0;
             added_pt.normal_z = 0;
-            layer = pl_orig.points[i].ring;
+            layer = pl_orig.ring(i);
             if (layer >= N_SCANS)
                 continue;
-            added_pt.x = pl_orig.points[i].x;
-            added_pt.y = pl_orig.points[i].y;
-            added_pt.z = pl_orig.points[i].z;
-            added_pt.intensity = pl_orig.points[i].intensity;
+            added_pt.x = pl_orig.x(i);
+            added_pt.y = pl_orig.y(i);
+            added_pt.z = pl_orig.z(i);
+            added_pt.intensity = pl_orig.intensity(i);
 
             double yaw_angle = atan2(added_pt.y, added_pt.x) * 57.2957;
 
@@ -343,25 +393,7 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
             pl_buff[layer].points.push_back(added_pt);
         }
 
-        for (int j = 0; j < N_SCANS; j++)
-        {
-            PointCloudXYZI &pl = pl_buff[j];
-            uint linesize = pl.size();
-            vector<orgtype> &types = typess[j];
-            types.clear();
-            types.resize(linesize);
-            linesize--;
-            for (uint i = 0; i < linesize; i++)
-            {
-                types[i].range = sqrt(pl[i].x * pl[i].x + pl[i].y * pl[i].y);//这个点的2维距离
-                vx = pl[i].x - pl[i + 1].x;
-                vy = pl[i].y - pl[i + 1].y;
-                vz = pl[i].z - pl[i + 1].z;
-                types[i].dista = vx * vx + vy * vy + vz * vz;//保存相邻点的距离
-            }
-            types[linesize].range = sqrt(pl[linesize].x * pl[linesize].x + pl[linesize].y * pl[linesize].y);
-            give_feature(pl, types);
-        }
+        extract_lines(true, 1);
     }
     else//不启用特征提取，采取fast-lio中的方法
     {
@@ -371,11 +403,11 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
             added_pt.normal_x = 0;
             added_pt.normal_y = 0;
             added_pt.normal_z = 0;
-            layer = pl_orig.points[i].ring;
-            added_pt.x = pl_orig.points[i].x;
-            added_pt.y = pl_orig.points[i].y;
-            added_pt.z = pl_orig.points[i].z;
-            added_pt.intensity = pl_orig.points[i].intensity;
+            layer = pl_orig.ring(i);
+            added_pt.x = pl_orig.x(i);
+            added_pt.y = pl_orig.y(i);
+            added_pt.z = pl_orig.z(i);
+            added_pt.intensity = pl_orig.intensity(i);
 
             double yaw_angle = atan2(added_pt.y, added_pt.x) * 57.2957;
 
@@ -424,13 +456,59 @@ void Preprocess::velodyne_handler(const sensor_msgs::PointCloud2::ConstPtr &msg)
 }
 
 
+/**
+ * @brief 各条line并行提取特征，每条line写到自己的输出缓存里，最后按line的顺序拼接到pl_surf/pl_corn
+ *        拼接顺序和串行时一样，输出与线程数无关
+ *
+ * @param sqrt_range  range是否开方(avia用的是平方)
+ * @param min_line_size  点数少于这个的line跳过
+ */
+void Preprocess::extract_lines(bool sqrt_range, uint min_line_size)
+{
+    parallel_for(scheduler, 0, N_SCANS, [&](int beg, int end) {
+        for (int j = beg; j < end; j++)
+        {
+            line_surf[j].clear();
+            line_corn[j].clear();
+            PointCloudXYZI &pl = pl_buff[j];
+            if (pl.size() < min_line_size)
+                continue;
+            uint linesize = pl.size();
+            vector<orgtype> &types = typess[j];
+            types.clear();
+            types.resize(linesize);
+            linesize--;
+            for (uint i = 0; i < linesize; i++)
+            {
+                float range2 = pl[i].x * pl[i].x + pl[i].y * pl[i].y;
+                types[i].range = sqrt_range ? sqrt(range2) : range2;//这个点的2维距离
+                double vx = pl[i].x - pl[i + 1].x;
+                double vy = pl[i].y - pl[i + 1].y;
+                double vz = pl[i].z - pl[i + 1].z;
+                types[i].dista = vx * vx + vy * vy + vz * vz;//保存相邻点的距离
+            }
+            float range2 = pl[linesize].x * pl[linesize].x + pl[linesize].y * pl[linesize].y;
+            types[linesize].range = sqrt_range ? sqrt(range2) : range2;
+            give_feature(pl, types, line_surf[j], line_corn[j]);
+        }
+    }, task_priority);
+
+    for (int j = 0; j < N_SCANS; j++)
+    {
+        pl_surf.insert(pl_surf.end(), line_surf[j].begin(), line_surf[j].end());
+        pl_corn.insert(pl_corn.end(), line_corn[j].begin(), line_corn[j].end());
+    }
+}
+
 /**
  * @brief 对于每条line的点云提取特征
  * 
  * @param pl  pcl格式的点云 输入进来一条扫描线上的点
  * @param types  点云的其他属性
+ * @param surf  这条line的面点输出
+ * @param corn  这条line的角点输出
  */
-void Preprocess::give_feature(pcl::PointCloud<PointType> &pl, vector<orgtype> &types)
+void Preprocess::give_feature(pcl::PointCloud<PointType> &pl, vector<orgtype> &types, PointCloudXYZI &surf, PointCloudXYZI &corn)
 {
     uint plsize = pl.size();
     uint plsize2;
@@ -709,7 +787,7 @@ void Preprocess::give_feature(pcl::PointCloud<PointType> &pl, vector<orgtype> &t
                 ap.y = pl[j].y;
                 ap.z = pl[j].z;
                 ap.curvature = pl[j].curvature;
-                pl_surf.push_back(ap);
+                surf.push_back(ap);
 
                 last_surface = -1;
             }
@@ -718,7 +796,7 @@ void Preprocess::give_feature(pcl::PointCloud<PointType> &pl, vector<orgtype> &t
         {
             if (types[j].ftype == Edge_Jump || types[j].ftype == Edge_Plane)
             {
-                pl_corn.push_back(pl[j]);
+                corn.push_back(pl[j]);
             }
             if (last_surface != -1)
             {
@@ -734,7 +812,7 @@ void Preprocess::give_feature(pcl::PointCloud<PointType> &pl, vector<orgtype> &t
                 ap.y /= (j - last_surface);
                 ap.z /= (j - last_surface);
                 ap.curvature /= (j - last_surface);
-                pl_surf.push_back(ap);
+                surf.push_back(ap);
             }
             last_surface = -1;
         }
@@ -756,7 +834,7 @@ int Preprocess::plane_judge(const PointCloudXYZI &pl, vector<orgtype> &types, ui
     double group_dis = disA * types[i_cur].range + disB;
     group_dis = group_dis * group_dis;
 
-    double two_dis;
+    double two_dis = 0, vx = 0, vy = 0, vz = 0;
     vector<double> disarr;
     disarr.reserve(20);
 
@@ -0,0 +1,88 @@
+#include "scan_ingest.h"
+#include "preprocess.h"
+
+ScanIngest::ScanIngest()
+{
+    capacity = 4;
+    running = false;
+    scan_num = 0;
+    drop_num = 0;
+}
+
+ScanIngest::~ScanIngest()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    sig.notify_all();
+    worker.join();
+}
+
+void ScanIngest::init(const shared_ptr<Preprocess> &pre_param, int capacity_param, const Deliver &deliver_param)
+{
+    pre = pre_param;
+    capacity = max(1, capacity_param);
+    deliver = deliver_param;
+    running = true;
+    worker = std::thread(&ScanIngest::run, this);
+}
+
+void ScanIngest::push(const livox_ros_driver::CustomMsg::ConstPtr &msg)
+{
+    RawScan scan;
+    scan.stamp = msg->header.stamp.toSec();
+    scan.livox = msg;
+    enqueue(scan);
+}
+
+void ScanIngest::push(const sensor_msgs::PointCloud2::ConstPtr &msg)
+{
+    RawScan scan;
+    scan.stamp = msg->header.stamp.toSec();
+    scan.cloud = msg;
+    enqueue(scan);
+}
+
+void ScanIngest::enqueue(const RawScan &scan)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!running)
+            return;
+        //; 预处理跟不上时丢掉最旧的一帧，不能在回调里等: 回调在主线程的spinOnce里执行，等待会卡住估计和IMU回调
+        if (scans.size() >= capacity)
+        {
+            scans.pop_front();
+            drop_num++;
+        }
+        scans.push_back(scan);
+    }
+    sig.notify_all();
+}
+
+void ScanIngest::run()
+{
+    while (true)
+    {
+        RawScan scan;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            sig.wait(lock, [this] { return !running || !scans.empty(); });
+            if (!running)
+                return;
+            scan = scans.front();
+            scans.pop_front();
+        }
+
+        PointCloudXYZI::Ptr ptr(new PointCloudXYZI());
+        if (scan.livox)
+            pre->process(scan.livox, ptr);
+        else
+            pre->process(scan.cloud, ptr);
+        scan_num++;
+        deliver(scan.stamp, ptr);
+    }
+}
@@ -0,0 +1,216 @@
+#include "task_scheduler.h"
+#include <cstdio>
+#include <pthread.h>
+#include <sched.h>
+
+#define TASK_CHUNKS_PER_THREAD (4) //; 每个线程平均分到的块数，块太少负载不均，太多调度开销大
+
+TaskScheduler::TaskScheduler()
+{
+    running = false;
+    pending = 0;
+    next = 0;
+    job_num = 0;
+    task_num = 0;
+    steal_num = 0;
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    if (!running)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    sig.notify_all();
+    for (int i = 0; i < workers.size(); i++)
+        workers[i].join();
+}
+
+void TaskScheduler::init(int thread_num_param, const std::vector<int> &cores)
+{
+    if (running)
+        return;
+    int worker_num = thread_num_param - 1;
+    if (worker_num < 1)
+        return; //; 一个线程就不开工作线程，parallel_for直接串行
+    running = true;
+    for (int i = 0; i < worker_num; i++)
+        queues.emplace_back(new Queue);
+    for (int i = 0; i < worker_num; i++)
+    {
+        workers.emplace_back(&TaskScheduler::run, this, i);
+        if (cores.empty())
+            continue;
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(cores[i % cores.size()], &cpuset);
+        if (pthread_setaffinity_np(workers[i].native_handle(), sizeof(cpu_set_t), &cpuset) != 0)
+            printf("[ TaskScheduler ]: cannot pin worker %d to core %d\n", i, cores[i % cores.size()]);
+    }
+}
+
+void TaskScheduler::parallel_for(int begin, int end, const RangeBody &body, int priority, int grain)
+{
+    int n = end - begin;
+    if (n <= 0)
+        return;
+    grain = grain > 0 ? grain : 1;
+    int chunk_num = std::min((n + grain - 1) / grain, thread_num() * TASK_CHUNKS_PER_THREAD);
+    if (!running || chunk_num <= 1)
+    {
+        body(begin, end);
+        return;
+    }
+    priority = std::max(0, std::min(priority, TASK_PRIORITY_NUM - 1));
+
+    Job job;
+    job.body = &body;
+    job.detached = false;
+    job.remaining = chunk_num;
+    job_num++;
+
+    //; 第0块留给调用线程，其余的轮流放到各个线程的队列里
+    unsigned start = next++;
+    for (int c = 1; c < chunk_num; c++)
+    {
+        Task task;
+        task.job = &job;
+        task.beg = begin + int(long(n) * c / chunk_num);
+        task.end = begin + int(long(n) * (c + 1) / chunk_num);
+        Queue &queue = *queues[(start + c) % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.m);
+        queue.tasks[priority].push_back(task);
+    }
+    pending += chunk_num - 1;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+    }
+    sig.notify_all();
+
+    Task task;
+    task.job = &job;
+    task.beg = begin;
+    task.end = begin + int(long(n) / chunk_num);
+    execute(task);
+    while (job.remaining > 0 && pop_job(&job, task))
+        execute(task);
+
+    std::unique_lock<std::mutex> lock(job.m);
+    job.done.wait(lock, [&job] { return job.remaining == 0; });
+}
+
+bool TaskScheduler::submit(const std::function<void()> &func, int priority)
+{
+    if (!running)
+        return false;
+    priority = std::max(0, std::min(priority, TASK_PRIORITY_NUM - 1));
+    Job *job = new Job;
+    job->own = [func](int, int) { func(); };
+    job->body = &job->own;
+    job->detached = true;
+    job->remaining = 1;
+
+    Task task;
+    task.job = job;
+    task.beg = 0;
+    task.end = 1;
+    {
+        Queue &queue = *queues[next++ % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.m);
+        queue.tasks[priority].push_back(task);
+    }
+    pending++;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+    }
+    sig.notify_all();
+    return true;
+}
+
+bool TaskScheduler::pop(int self, Task &task)
+{
+    int queue_num = queues.size();
+    for (int p = 0; p < TASK_PRIORITY_NUM; p++)
+    {
+        for (int k = 0; k < queue_num; k++)
+        {
+            Queue &queue = *queues[(self + k) % queue_num];
+            std::lock_guard<std::mutex> lock(queue.m);
+            std::deque<Task> &tasks = queue.tasks[p];
+            if (tasks.empty())
+                continue;
+            if (k == 0)
+            {
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            else
+            {
+                task = tasks.back();
+                tasks.pop_back();
+                steal_num++;
+            }
+            pending--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool TaskScheduler::pop_job(const Job *job, Task &task)
+{
+    for (int k = 0; k < queues.size(); k++)
+    {
+        Queue &queue = *queues[k];
+        std::lock_guard<std::mutex> lock(queue.m);
+        for (int p = 0; p < TASK_PRIORITY_NUM; p++)
+        {
+            std::deque<Task> &tasks = queue.tasks[p];
+            for (int i = int(tasks.size()) - 1; i >= 0; i--)
+            {
+                if (tasks[i].job != job)
+                    continue;
+                task = tasks[i];
+                tasks.erase(tasks.begin() + i);
+                pending--;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TaskScheduler::execute(const Task &task)
+{
+    Job *job = task.job;
+    (*job->body)(task.beg, task.end);
+    task_num++;
+    if (job->detached)
+    {
+        delete job;
+        return;
+    }
+    //; 最后一块做完时job还在调用线程的栈上，先拿锁再减，保证调用线程被唤醒之前不会返回
+    std::lock_guard<std::mutex> lock(job->m);
+    if (--job->remaining == 0)
+        job->done.notify_all();
+}
+
+void TaskScheduler::run(int id)
+{
+    while (true)
+    {
+        Task task;
+        if (pop(id, task))
+        {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        sig.wait(lock, [this] { return !running || pending > 0; });
+        if (!running && pending <= 0)
+            return; //; 退出前把submit进来还没做的任务做完
+    }
+}
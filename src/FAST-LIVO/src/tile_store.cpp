@@ -0,0 +1,251 @@
+#include "tile_store.h"
+#include <ctime>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define TILE_POINT_FLOATS 8  //; x y z intensity normal_x normal_y normal_z curvature
+
+TileStore::TileStore()
+{
+    tile_size = 50.0;
+    running = false;
+    stored_num = 0;
+    loaded_num = 0;
+    hold_valid = false;
+}
+
+TileStore::~TileStore()
+{
+    if (dir.empty())
+        return;
+    stop();
+    //; tile只在本次运行中有效，删掉自己写的文件和子目录
+    for (auto iter = on_disk.begin(); iter != on_disk.end(); ++iter)
+        unlink(tile_file(*iter).c_str());
+    rmdir(dir.c_str());
+}
+
+void TileStore::stop()
+{
+    if (!worker.joinable())
+        return;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        running = false;
+    }
+    sig.notify_all();
+    worker.join();
+}
+
+void TileStore::init(const string &dir_param, double tile_size_param)
+{
+    dir = dir_param;
+    if (dir.back() != '/')
+        dir += "/";
+    tile_size = tile_size_param;
+    for (size_t pos = dir.find('/', 1); pos != string::npos; pos = dir.find('/', pos + 1))
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+    //; 每次运行新建一个子目录，不碰目录里已有的文件
+    char run_name[64];
+    time_t now = time(nullptr);
+    strftime(run_name, sizeof(run_name), "run_%Y%m%d_%H%M%S", localtime(&now));
+    dir += string(run_name) + "_" + to_string(getpid()) + "/";
+    if (mkdir(dir.c_str(), 0755) != 0)
+    {
+        printf("[ TileStore ]: cannot create %s, tile store disabled\n", dir.c_str());
+        return;
+    }
+    running = true;
+    worker = std::thread(&TileStore::run, this);
+}
+
+VOXEL_KEY TileStore::key_of(float x, float y, float z) const
+{
+    return VOXEL_KEY(floor(x / tile_size), floor(y / tile_size), floor(z / tile_size));
+}
+
+string TileStore::tile_file(const VOXEL_KEY &key) const
+{
+    return dir + to_string(key.x) + "_" + to_string(key.y) + "_" + to_string(key.z) + ".tile";
+}
+
+void TileStore::Store(const PointVector &points)
+{
+    if (!running || points.empty())
+        return;
+    TileTask task;
+    task.load = false;
+    task.points = points;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        tasks.push_back(std::move(task));
+    }
+    sig.notify_one();
+}
+
+bool TileStore::tile_in_region(const VOXEL_KEY &key) const
+{
+    if (!hold_valid)
+        return false;
+    int64_t k[3] = {key.x, key.y, key.z};
+    bool in_cube = true, in_shifted = true;
+    for (int i = 0; i < 3; i++)
+    {
+        double lo = k[i] * tile_size, hi = lo + tile_size;
+        in_cube = in_cube && hi > hold_cube.vertex_min[i] && lo < hold_cube.vertex_max[i];
+        in_shifted = in_shifted && hi > hold_cube.vertex_min[i] + hold_shift(i) && lo < hold_cube.vertex_max[i] + hold_shift(i);
+    }
+    return in_cube || in_shifted;
+}
+
+void TileStore::Prefetch(const BoxPointType &cube, const V3D &shift)
+{
+    if (!running)
+        return;
+    //; 只读回和局部地图cube相交的tile，shift是按匀速模型预测的cube平移，提前读回车将要到的地方
+    bool notify = false;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        hold_cube = cube;
+        hold_shift = shift;
+        hold_valid = true;
+        for (auto iter = on_disk.begin(); iter != on_disk.end(); ++iter)
+        {
+            if (loading.count(*iter) || !tile_in_region(*iter))
+                continue;
+            TileTask task;
+            task.load = true;
+            task.key = *iter;
+            tasks.push_back(std::move(task));
+            loading.insert(*iter);
+            notify = true;
+        }
+    }
+    if (notify)
+        sig.notify_one();
+}
+
+bool TileStore::Fetch(const BoxPointType &cube, PointVector &points)
+{
+    points.clear();
+    PointVector keep, store;
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (loaded.empty())
+            return false;
+        //; cube里的点加回地图；cube外但tile还在预取范围里的先留在内存；其余的重新写盘，地图不会超出cube
+        for (int i = 0; i < loaded.size(); i++)
+        {
+            const PointType &p = loaded[i];
+            if (p.x >= cube.vertex_min[0] && p.x < cube.vertex_max[0] && p.y >= cube.vertex_min[1] && p.y < cube.vertex_max[1] &&
+                p.z >= cube.vertex_min[2] && p.z < cube.vertex_max[2])
+                points.push_back(p);
+            else if (tile_in_region(key_of(p.x, p.y, p.z)))
+                keep.push_back(p);
+            else
+                store.push_back(p);
+        }
+        loaded.swap(keep);
+    }
+    Store(store);
+    return !points.empty();
+}
+
+int TileStore::tile_num()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+    return on_disk.size();
+}
+
+void TileStore::Collect(PointVector &points)
+{
+    //; 后台线程退出前会把队列里的写盘任务做完，之后on_disk和loaded只有主线程访问
+    stop();
+    for (auto iter = on_disk.begin(); iter != on_disk.end(); ++iter)
+        read_tile(tile_file(*iter), points);
+    points.insert(points.end(), loaded.begin(), loaded.end());
+    loaded.clear();
+}
+
+void TileStore::write_points(PointVector &points)
+{
+    unordered_map<VOXEL_KEY, vector<float>> tiles;
+    for (int i = 0; i < points.size(); i++)
+    {
+        const PointType &p = points[i];
+        vector<float> &buf = tiles[key_of(p.x, p.y, p.z)];
+        float data[TILE_POINT_FLOATS] = {p.x, p.y, p.z, p.intensity, p.normal_x, p.normal_y, p.normal_z, p.curvature};
+        buf.insert(buf.end(), data, data + TILE_POINT_FLOATS);
+    }
+    for (auto iter = tiles.begin(); iter != tiles.end(); ++iter)
+    {
+        FILE *fp = fopen(tile_file(iter->first).c_str(), "ab");
+        if (fp == nullptr)
+        {
+            printf("[ TileStore ]: cannot write tile %s\n", tile_file(iter->first).c_str());
+            continue;
+        }
+        fwrite(iter->second.data(), sizeof(float), iter->second.size(), fp);
+        fclose(fp);
+        std::lock_guard<std::mutex> lock(mtx);
+        on_disk.insert(iter->first);
+        stored_num += iter->second.size() / TILE_POINT_FLOATS;
+    }
+}
+
+bool TileStore::read_tile(const string &file, PointVector &points)
+{
+    FILE *fp = fopen(file.c_str(), "rb");
+    if (fp == nullptr)
+        return false;
+    float data[TILE_POINT_FLOATS];
+    while (fread(data, sizeof(float), TILE_POINT_FLOATS, fp) == TILE_POINT_FLOATS)
+    {
+        PointType p;
+        p.x = data[0];
+        p.y = data[1];
+        p.z = data[2];
+        p.intensity = data[3];
+        p.normal_x = data[4];
+        p.normal_y = data[5];
+        p.normal_z = data[6];
+        p.curvature = data[7];
+        points.push_back(p);
+    }
+    fclose(fp);
+    return true;
+}
+
+void TileStore::load_tile(const VOXEL_KEY &key)
+{
+    string file = tile_file(key);
+    PointVector points;
+    if (read_tile(file, points))
+        unlink(file.c_str()); //; 点回到内存地图里了，之后再被删掉会重新写盘
+    std::lock_guard<std::mutex> lock(mtx);
+    on_disk.erase(key);
+    loading.erase(key);
+    loaded.insert(loaded.end(), points.begin(), points.end());
+    loaded_num += points.size();
+}
+
+void TileStore::run()
+{
+    while (true)
+    {
+        TileTask task;
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            sig.wait(lock, [this] { return !running || !tasks.empty(); });
+            if (!running && tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        //; 任务按顺序执行，同一个tile先写后读不会丢点
+        if (task.load)
+            load_tile(task.key);
+        else
+            write_points(task.points);
+    }
+}
@@ -0,0 +1,165 @@
+#include "voxel_downsample.h"
+
+#define VOXEL_POINT_GRAIN (1024) //; 计算体素时每块至少这么多点
+
+VoxelDownsample::VoxelDownsample()
+{
+    setLeafSize(0.5f, 0.5f, 0.5f);
+    select_mode = VOXEL_CENTROID;
+    thread_num = 1;
+    scheduler = nullptr;
+}
+
+void VoxelDownsample::set_scheduler(TaskScheduler *scheduler_param)
+{
+    scheduler = scheduler_param;
+    thread_num = scheduler != nullptr ? scheduler->thread_num() : 1;
+}
+
+void VoxelDownsample::setLeafSize(float lx, float ly, float lz)
+{
+    leaf[0] = lx;
+    leaf[1] = ly;
+    leaf[2] = lz;
+    for (int j = 0; j < 3; j++)
+        inv_leaf[j] = 1.0f / leaf[j];
+}
+
+void VoxelDownsample::reduce(Partition &part, int beg, int end)
+{
+    part.index.clear();
+    part.voxels.clear();
+    const auto &points = input->points;
+    for (int k = beg; k < end; k++)
+    {
+        const int i = order[k];
+        const PointType &p = points[i];
+        auto iter = part.index.find(keys[i]);
+        int v;
+        if (iter == part.index.end())
+        {
+            v = part.voxels.size();
+            part.index.emplace(keys[i], v);
+            part.voxels.emplace_back();
+            VoxelAccum &acc = part.voxels.back();
+            acc.n = 0;
+            acc.best = i;
+            acc.best_dist = INFINITY;
+            memset(acc.sum, 0, sizeof(acc.sum));
+        }
+        else
+        {
+            v = iter->second;
+        }
+        VoxelAccum &acc = part.voxels[v];
+        acc.n++;
+        if (select_mode == VOXEL_NEAREST)
+        {
+            float dx = p.x - (keys[i].x + 0.5f) * leaf[0];
+            float dy = p.y - (keys[i].y + 0.5f) * leaf[1];
+            float dz = p.z - (keys[i].z + 0.5f) * leaf[2];
+            float dist = dx * dx + dy * dy + dz * dz;
+            if (dist < acc.best_dist)
+            {
+                acc.best_dist = dist;
+                acc.best = i;
+            }
+        }
+        else
+        {
+            acc.sum[0] += p.x;
+            acc.sum[1] += p.y;
+            acc.sum[2] += p.z;
+            acc.sum[3] += p.intensity;
+            acc.sum[4] += p.normal_x;
+            acc.sum[5] += p.normal_y;
+            acc.sum[6] += p.normal_z;
+            acc.sum[7] += p.curvature;
+        }
+    }
+}
+
+void VoxelDownsample::filter(PointCloudXYZI &output)
+{
+    output.clear();
+    if (!input || input->empty())
+        return;
+    const auto &points = input->points;
+    const int size = points.size();
+    keys.resize(size);
+    owner.resize(size);
+    if (int(partitions.size()) != thread_num)
+        partitions.resize(thread_num);
+
+    // Step 1: 计算每个点的体素，并按体素哈希值分配给线程，同一个体素的点一定在同一个线程
+    std::hash<VOXEL_KEY> hasher;
+    parallel_for(scheduler, 0, size, [&](int i_beg, int i_end) {
+        for (int i = i_beg; i < i_end; i++)
+        {
+            const PointType &p = points[i];
+            if (!std::isfinite(p.x) || !std::isfinite(p.y) || !std::isfinite(p.z))
+            {
+                owner[i] = -1;
+                continue;
+            }
+            keys[i] = VOXEL_KEY(floor(p.x * inv_leaf[0]), floor(p.y * inv_leaf[1]), floor(p.z * inv_leaf[2]));
+            owner[i] = hasher(keys[i]) % thread_num;
+        }
+    }, TASK_CRITICAL, VOXEL_POINT_GRAIN);
+
+    // Step 2: 计数排序把点按线程分桶(桶内保持原始顺序)，每个线程在自己的哈希表里归并自己的桶
+    bucket.assign(thread_num + 1, 0);
+    for (int i = 0; i < size; i++)
+    {
+        if (owner[i] >= 0)
+            bucket[owner[i] + 1]++;
+    }
+    for (int t = 0; t < thread_num; t++)
+        bucket[t + 1] += bucket[t];
+    order.resize(bucket[thread_num]);
+    vector<int> fill(bucket.begin(), bucket.end() - 1);
+    for (int i = 0; i < size; i++)
+    {
+        if (owner[i] >= 0)
+            order[fill[owner[i]]++] = i;
+    }
+    parallel_for(scheduler, 0, thread_num, [&](int t_beg, int t_end) {
+        for (int t = t_beg; t < t_end; t++)
+            reduce(partitions[t], bucket[t], bucket[t + 1]);
+    });
+
+    // Step 3: 按线程顺序拼接输出
+    vector<int> offset(thread_num + 1, 0);
+    for (int t = 0; t < thread_num; t++)
+        offset[t + 1] = offset[t] + partitions[t].voxels.size();
+    output.resize(offset[thread_num]);
+    parallel_for(scheduler, 0, thread_num, [&](int t_beg, int t_end) {
+        for (int t = t_beg; t < t_end; t++)
+        {
+            const vector<VoxelAccum> &voxels = partitions[t].voxels;
+            for (int v = 0; v < voxels.size(); v++)
+            {
+                const VoxelAccum &acc = voxels[v];
+                PointType &p = output.points[offset[t] + v];
+                if (select_mode == VOXEL_NEAREST)
+                {
+                    p = points[acc.best];
+                    continue;
+                }
+                float inv_n = 1.0f / acc.n;
+                p.x = acc.sum[0] * inv_n;
+                p.y = acc.sum[1] * inv_n;
+                p.z = acc.sum[2] * inv_n;
+                p.intensity = acc.sum[3] * inv_n;
+                p.normal_x = acc.sum[4] * inv_n;
+                p.normal_y = acc.sum[5] * inv_n;
+                p.normal_z = acc.sum[6] * inv_n;
+                p.curvature = acc.sum[7] * inv_n;
+            }
+        }
+    });
+    output.header = input->header;
+    output.width = output.points.size();
+    output.height = 1;
+    output.is_dense = true;
+}
@@ -0,0 +1,126 @@
+//; IMU协方差传播测试: propagate_cov(块稀疏，原地更新) 对比稠密的 F_x * P * F_x^T + cov_w
+//; 按400Hz和1kHz两种IMU频率生成一段连续转动、加减速的IMU数据，每个采样从同一个P出发各传播一步，检查相对误差；
+//; 再各自连续传播整段数据，检查累积之后的差；最后分别计时，给出每个采样和每秒IMU数据的耗时
+//; 用法: cov_propagation_test [秒数]，误差超限时返回1
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <common_lib.h>
+
+#define COV_TOLERANCE (1e-10) //; 和COV_PROPAGATION_CHECK一样的容差
+#define COV_GYR (1e-4)        //; 初始化时估计出来的量级
+#define COV_ACC (1e-2)
+#define COV_BIAS_GYR (0.00003) //; laserMapping里set_gyr_bias_cov的值
+#define COV_BIAS_ACC (0.01)    //; laserMapping里set_acc_bias_cov的值
+
+struct ImuSample
+{
+    M3D R_imu;
+    V3D acc_avr, angvel_avr;
+};
+
+const V3D cov_gyr = V3D::Constant(COV_GYR), cov_acc = V3D::Constant(COV_ACC);
+const V3D cov_bias_gyr = V3D::Constant(COV_BIAS_GYR), cov_bias_acc = V3D::Constant(COV_BIAS_ACC);
+
+//; 原来Forward/UndistortPcl里的写法: 拼出完整的F_x和cov_w做两次18x18乘法
+static void propagate_cov_dense(MD(DIM_STATE, DIM_STATE) &cov, const M3D &R_imu, const V3D &acc_avr, const V3D &angvel_avr, double dt)
+{
+    M3D acc_avr_skew;
+    acc_avr_skew << SKEW_SYM_MATRX(acc_avr);
+    MD(DIM_STATE, DIM_STATE) F_x, cov_w;
+    F_x.setIdentity();
+    cov_w.setZero();
+    F_x.block<3, 3>(0, 0) = Exp(angvel_avr, -dt);
+    F_x.block<3, 3>(0, 9) = -M3D::Identity() * dt;
+    F_x.block<3, 3>(3, 6) = M3D::Identity() * dt;
+    F_x.block<3, 3>(6, 0) = -R_imu * acc_avr_skew * dt;
+    F_x.block<3, 3>(6, 12) = -R_imu * dt;
+    F_x.block<3, 3>(6, 15) = M3D::Identity() * dt;
+    cov_w.block<3, 3>(0, 0).diagonal() = cov_gyr * dt * dt;
+    cov_w.block<3, 3>(6, 6) = R_imu * cov_acc.asDiagonal() * R_imu.transpose() * dt * dt;
+    cov_w.block<3, 3>(9, 9).diagonal() = cov_bias_gyr * dt * dt;
+    cov_w.block<3, 3>(12, 12).diagonal() = cov_bias_acc * dt * dt;
+    cov = F_x * cov * F_x.transpose() + cov_w;
+}
+
+static double rel_err(const MD(DIM_STATE, DIM_STATE) &a, const MD(DIM_STATE, DIM_STATE) &b)
+{
+    return (a - b).cwiseAbs().maxCoeff() / std::max(b.cwiseAbs().maxCoeff(), 1e-12);
+}
+
+//; 绕三个轴慢慢摆动，加速度是重力加上前后的加减速，都带一点噪声
+static void make_imu(double rate, double seconds, std::mt19937 &rng, std::vector<ImuSample> &samples)
+{
+    std::normal_distribution<double> nd(0.0, 1.0);
+    double dt = 1.0 / rate;
+    int num = int(rate * seconds);
+    M3D R_imu = M3D::Identity();
+    samples.resize(num);
+    for (int i = 0; i < num; i++)
+    {
+        double t = i * dt;
+        V3D angvel(0.3 * sin(0.7 * t), 0.2 * sin(1.1 * t + 1.0), 0.5 * sin(0.3 * t + 2.0));
+        V3D acc_world(1.5 * sin(0.4 * t), 0.5 * cos(0.9 * t), G_m_s2);
+        samples[i].R_imu = R_imu;
+        samples[i].angvel_avr = angvel + V3D(nd(rng), nd(rng), nd(rng)) * 0.01;
+        samples[i].acc_avr = R_imu.transpose() * acc_world + V3D(nd(rng), nd(rng), nd(rng)) * 0.05;
+        R_imu = R_imu * Exp(samples[i].angvel_avr, dt);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 60.0;
+    const double rates[2] = {400.0, 1000.0};
+    std::mt19937 rng(41);
+
+    //; 初始协方差是对角占优的随机正定矩阵，状态之间带一点相关性
+    MD(DIM_STATE, DIM_STATE) P_init = MD(DIM_STATE, DIM_STATE)::Random() * 0.003;
+    P_init = P_init * P_init.transpose() + MD(DIM_STATE, DIM_STATE)::Identity() * 0.01;
+
+    bool ok = true;
+    printf("%g s of IMU data per rate\n", seconds);
+    printf("%-8s %8s %12s %12s %14s %14s %12s %12s %8s\n", "rate", "samples", "step err", "final err", "sparse ns/smp",
+           "dense ns/smp", "sparse ms/s", "dense ms/s", "speedup");
+    for (int r = 0; r < 2; r++)
+    {
+        double dt = 1.0 / rates[r];
+        std::vector<ImuSample> samples;
+        make_imu(rates[r], seconds, rng, samples);
+        int num = samples.size();
+
+        //; 每一步从同一个P出发比较，P本身按块稀疏的结果往前走
+        double step_err = 0;
+        MD(DIM_STATE, DIM_STATE) cov = P_init, cov_dense;
+        for (int i = 0; i < num; i++)
+        {
+            cov_dense = cov;
+            propagate_cov_dense(cov_dense, samples[i].R_imu, samples[i].acc_avr, samples[i].angvel_avr, dt);
+            propagate_cov(cov, samples[i].R_imu, samples[i].acc_avr, samples[i].angvel_avr, dt, cov_gyr, cov_acc, cov_bias_gyr,
+                          cov_bias_acc);
+            step_err = std::max(step_err, rel_err(cov, cov_dense));
+        }
+
+        //; 两种写法各自连续传播，计时
+        MD(DIM_STATE, DIM_STATE) cov_sparse = P_init;
+        double t0 = omp_get_wtime();
+        for (int i = 0; i < num; i++)
+            propagate_cov(cov_sparse, samples[i].R_imu, samples[i].acc_avr, samples[i].angvel_avr, dt, cov_gyr, cov_acc, cov_bias_gyr,
+                          cov_bias_acc);
+        double t1 = omp_get_wtime();
+        cov_dense = P_init;
+        for (int i = 0; i < num; i++)
+            propagate_cov_dense(cov_dense, samples[i].R_imu, samples[i].acc_avr, samples[i].angvel_avr, dt);
+        double t2 = omp_get_wtime();
+        double final_err = rel_err(cov_sparse, cov_dense);
+
+        double sparse_time = (t1 - t0) / num, dense_time = (t2 - t1) / num;
+        printf("%-8s %8d %12.2e %12.2e %14.1f %14.1f %12.3f %12.3f %8.2f\n", r == 0 ? "400Hz" : "1kHz", num, step_err, final_err,
+               sparse_time * 1e9, dense_time * 1e9, sparse_time * rates[r] * 1e3, dense_time * rates[r] * 1e3, dense_time / sparse_time);
+        ok = ok && step_err <= COV_TOLERANCE && final_err <= COV_TOLERANCE;
+    }
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+//; IKFoM迭代更新测试: update_iterated_fixed_share(定长H^T H) 对比原来的 update_iterated_dyn_share_modified
+//; 状态是use-ikfom.hpp里的state_ikfom，观测是点到平面残差，只和位姿(前6维)有关，外参不估计
+//; fixed_share<12>和原来一样带上外参的6列(全0)，fixed_share<6>只带位姿，三者的状态和协方差必须一致
+//; 用法: ikfom_fixed_share_test [点数] [次数]，误差超限时返回1
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <use-ikfom.hpp>
+
+#define FIXED_MEAS_COV (0.001) //; laser_point_cov的默认值
+#define FIXED_MAX_ITER (4)
+#define FIXED_TOLERANCE (1e-9)
+
+//; 雷达系的点，和世界系下它所在平面的法向量、截距
+std::vector<Eigen::Vector3d> points_body, plane_normal;
+std::vector<double> plane_d;
+
+//; 和laserMapping里的残差一样: r = n^T (R (R_LI p + t_LI) + t) + d，对位姿的雅可比是 [n^T, (p_I x R^T n)^T]
+template <typename Func>
+static void plane_residuals(state_ikfom &s, Func add)
+{
+    for (int i = 0; i < points_body.size(); i++)
+    {
+        Eigen::Vector3d p_imu = s.offset_R_L_I * points_body[i] + s.offset_T_L_I;
+        Eigen::Vector3d p_world = s.rot * p_imu + s.pos;
+        double r = plane_normal[i].dot(p_world) + plane_d[i];
+        Eigen::Matrix<double, 6, 1> J;
+        J << plane_normal[i], p_imu.cross(s.rot.conjugate() * plane_normal[i]);
+        add(i, J, -r);
+    }
+}
+
+static void h_dyn_share(state_ikfom &s, esekfom::dyn_share_datastruct<double> &ekfom_data)
+{
+    ekfom_data.h_x = Eigen::MatrixXd::Zero(points_body.size(), 12);
+    ekfom_data.h.resize(points_body.size());
+    plane_residuals(s, [&](int i, const Eigen::Matrix<double, 6, 1> &J, double h) {
+        ekfom_data.h_x.block<1, 6>(i, 0) = J.transpose();
+        ekfom_data.h(i) = h;
+    });
+}
+
+template <int h_cols>
+static void h_fixed_share(state_ikfom &s, esekfom::fixed_share_datastruct<double, h_cols> &ekfom_data)
+{
+    ekfom_data.HTH.setZero();
+    ekfom_data.HTh.setZero();
+    plane_residuals(s, [&](int i, const Eigen::Matrix<double, 6, 1> &J, double h) {
+        ekfom_data.HTH.template block<6, 6>(0, 0) += J * J.transpose();
+        ekfom_data.HTh.template head<6>() += J * h;
+    });
+}
+
+typedef esekfom::esekf<state_ikfom, 12, input_ikfom> esekf_ikfom;
+
+//; 两个滤波器更新之后的差: 状态用boxminus，协方差用相对的Frobenius范数
+static void compare(esekf_ikfom &a, esekf_ikfom &b, double &dx, double &dP)
+{
+    Eigen::Matrix<double, 23, 1> diff;
+    a.get_x().boxminus(diff, b.get_x());
+    dx = std::max(dx, diff.norm());
+    dP = std::max(dP, (a.get_P() - b.get_P()).norm() / a.get_P().norm());
+}
+
+int main(int argc, char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 3000;
+    int repeat = argc > 2 ? atoi(argv[2]) : 50;
+    std::mt19937 rng(45);
+    std::normal_distribution<double> nd(0.0, 1.0);
+
+    state_ikfom truth;
+    truth.pos = vect3(Eigen::Vector3d(1.0, 2.0, 0.3));
+    truth.rot = SO3(Eigen::AngleAxisd(0.3, Eigen::Vector3d::UnitZ()));
+    truth.offset_T_L_I = vect3(Eigen::Vector3d(0.04165, 0.02326, -0.0284));
+    for (int i = 0; i < num; i++)
+    {
+        Eigen::Vector3d p(nd(rng) * 15, nd(rng) * 15, nd(rng) * 3), n(nd(rng), nd(rng), nd(rng));
+        n.normalize();
+        Eigen::Vector3d p_world = truth.rot * (truth.offset_R_L_I * p + truth.offset_T_L_I) + truth.pos;
+        points_body.push_back(p);
+        plane_normal.push_back(n);
+        plane_d.push_back(-n.dot(p_world) + 0.01 * nd(rng));
+    }
+
+    double epsi[23];
+    std::fill(epsi, epsi + 23, 0.001);
+    esekf_ikfom kf_dyn, kf_fixed;
+    kf_dyn.init_dyn_share(get_f, df_dx, df_dw, h_dyn_share, FIXED_MAX_ITER, epsi);
+    kf_fixed.init_dyn_runtime_share(get_f, df_dx, df_dw, FIXED_MAX_ITER, epsi);
+
+    double time_dyn = 0, time_fixed12 = 0, time_fixed6 = 0, solve_time = 0;
+    double dx12 = 0, dP12 = 0, dx6 = 0, dP6 = 0, pos_err = 0;
+    for (int r = 0; r < repeat; r++)
+    {
+        //; 初值在真值附近随机扰动，协方差是对角占优的随机正定矩阵(状态之间带一点相关性)
+        state_ikfom init = truth;
+        init.pos = vect3(truth.pos + Eigen::Vector3d(nd(rng), nd(rng), nd(rng)) * 0.05);
+        init.rot = SO3(truth.rot * Eigen::AngleAxisd(0.02 * nd(rng), Eigen::Vector3d(nd(rng), nd(rng), nd(rng)).normalized()));
+        esekf_ikfom::cov P_init = esekf_ikfom::cov::Random() * 0.003;
+        P_init = P_init * P_init.transpose() + esekf_ikfom::cov::Identity() * 0.01;
+
+        kf_dyn.change_x(init);
+        kf_dyn.change_P(P_init);
+        double t0 = omp_get_wtime();
+        kf_dyn.update_iterated_dyn_share_modified(FIXED_MEAS_COV, solve_time);
+        double t1 = omp_get_wtime();
+        time_dyn += t1 - t0;
+
+        kf_fixed.change_x(init);
+        kf_fixed.change_P(P_init);
+        t0 = omp_get_wtime();
+        kf_fixed.update_iterated_fixed_share<12>(FIXED_MEAS_COV, h_fixed_share<12>, solve_time);
+        t1 = omp_get_wtime();
+        time_fixed12 += t1 - t0;
+        compare(kf_dyn, kf_fixed, dx12, dP12);
+
+        kf_fixed.change_x(init);
+        kf_fixed.change_P(P_init);
+        t0 = omp_get_wtime();
+        kf_fixed.update_iterated_fixed_share<6>(FIXED_MEAS_COV, h_fixed_share<6>, solve_time);
+        t1 = omp_get_wtime();
+        time_fixed6 += t1 - t0;
+        compare(kf_dyn, kf_fixed, dx6, dP6);
+
+        pos_err = std::max(pos_err, (kf_fixed.get_x().pos - truth.pos).norm());
+    }
+
+    bool ok = dx12 <= FIXED_TOLERANCE && dP12 <= FIXED_TOLERANCE && dx6 <= FIXED_TOLERANCE && dP6 <= FIXED_TOLERANCE;
+    printf("points %d, repeat %d, max position error to truth %.2e m\n", num, repeat, pos_err);
+    printf("%-16s %10s %10s %12s %8s\n", "update", "max dx", "max dP", "ms/update", "speedup");
+    printf("%-16s %10s %10s %12.3f %8s\n", "dyn_share", "-", "-", time_dyn / repeat * 1e3, "-");
+    printf("%-16s %10.2e %10.2e %12.3f %8.2f\n", "fixed_share<12>", dx12, dP12, time_fixed12 / repeat * 1e3, time_dyn / time_fixed12);
+    printf("%-16s %10.2e %10.2e %12.3f %8.2f\n", "fixed_share<6>", dx6, dP6, time_fixed6 / repeat * 1e3, time_dyn / time_fixed6);
+    printf(ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,129 @@
+//; IEKF增益测试: InfoFormSolver(Woodbury + 6x6 LDLT) 对比原来的闭式解 (H^T H + (P/c)^-1)^-1
+//; 几类协方差/观测: 随机、接近实际量级、观测退化(只约束部分位姿)、位姿块不正定(走退回分支)、协方差条件数很差
+//; 用法: info_form_solver_test [每类次数]，误差超限时返回1
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <common_lib.h>
+
+#define INFO_ITER_NUM (4) //; 一帧的迭代次数，set_prior只做一次
+#define INFO_MEAS_COV (0.001) //; laser_point_cov的默认值
+
+enum INFO_CASE
+{
+    INFO_RANDOM = 0,       //; 随机正定的P，随机的H
+    INFO_REALISTIC = 1,    //; 位姿方差1e-4量级，速度/零偏更大，带相关性，laser_point_cov和几百个观测
+    INFO_DEGENERATE = 2,   //; 走廊: H只约束了3个方向，H^T H奇异
+    INFO_NO_MEASURE = 3,   //; H^T H = 0，增益就是P'的前6列
+    INFO_POSE_SINGULAR = 4, //; 位姿块不正定，set_prior分解失败，走原来的闭式解，结果必须逐位相同
+    INFO_ILL = 5           //; P的特征值跨12个数量级
+};
+const char *case_name[] = {"random", "realistic", "degenerate", "no measure", "pose singular", "ill-conditioned"};
+//; 条件数1e12时两种算法本身的误差就有cond*eps ~ 1e-4，只能比到这个量级
+const double case_tolerance[] = {1e-8, 1e-8, 1e-8, 1e-8, 0, 1e-4};
+#define INFO_CASE_NUM (6)
+
+//; 对称正定矩阵，特征值在[10^lo, 10^hi]之间对数均匀分布
+static MD(DIM_STATE, DIM_STATE) random_spd(std::mt19937 &rng, double lo, double hi)
+{
+    std::uniform_real_distribution<double> u(lo, hi);
+    MD(DIM_STATE, DIM_STATE) R = MD(DIM_STATE, DIM_STATE)::Random();
+    HouseholderQR<MD(DIM_STATE, DIM_STATE)> qr(R);
+    MD(DIM_STATE, DIM_STATE) Q = qr.householderQ();
+    VD(DIM_STATE) eig;
+    for (int i = 0; i < DIM_STATE; i++)
+        eig(i) = pow(10.0, u(rng));
+    return Q * eig.asDiagonal() * Q.transpose();
+}
+
+static void make_case(std::mt19937 &rng, int type, MD(DIM_STATE, DIM_STATE) & P, MD(6, 6) & HTH, double &meas_cov)
+{
+    std::normal_distribution<double> nd(0.0, 1.0);
+    meas_cov = INFO_MEAS_COV;
+    int num = 500;
+    P = random_spd(rng, -5, -2);
+    if (type == INFO_REALISTIC)
+    {
+        VD(DIM_STATE) scale;
+        scale << 1e-2, 1e-2, 1e-2, 1e-2, 1e-2, 1e-2, 1e-1, 1e-1, 1e-1, 1e-2, 1e-2, 1e-2, 1e-3, 1e-3, 1e-3, 1e-1, 1e-1, 1e-1;
+        P = scale.asDiagonal() * random_spd(rng, -1, 0) * scale.asDiagonal();
+    }
+    if (type == INFO_ILL)
+        P = random_spd(rng, -12, 0);
+    if (type == INFO_POSE_SINGULAR)
+        P(0, 0) = -P(0, 0); //; 数值误差让P不再正定，位姿块的Cholesky会失败
+    Matrix<double, Dynamic, 6> H(num, 6);
+    for (int i = 0; i < num; i++)
+    {
+        //; 点到平面观测的雅可比: [ (p x n)^T, n^T ]
+        V3D p(nd(rng) * 20, nd(rng) * 20, nd(rng) * 2), n(nd(rng), nd(rng), nd(rng));
+        if (type == INFO_DEGENERATE)
+            n = V3D(0, nd(rng) > 0 ? 1 : -1, 0) + V3D(0, 0, nd(rng) * 0.1); //; 只有两侧墙和少量倾斜
+        n.normalize();
+        H.block<1, 3>(i, 0) = p.cross(n).transpose();
+        H.block<1, 3>(i, 3) = n.transpose();
+        if (type == INFO_DEGENERATE)
+            H.block<1, 3>(i, 0).setZero(); //; 旋转完全不可观
+    }
+    HTH = H.transpose() * H;
+    if (type == INFO_NO_MEASURE)
+        HTH.setZero();
+}
+
+//; 原来laserMapping里的写法
+static MD(DIM_STATE, 6) dense_gain(const MD(DIM_STATE, DIM_STATE) & P, const MD(6, 6) & HTH, double meas_cov)
+{
+    MD(DIM_STATE, DIM_STATE) H_T_H = MD(DIM_STATE, DIM_STATE)::Zero();
+    H_T_H.block<6, 6>(0, 0) = HTH;
+    MD(DIM_STATE, DIM_STATE) K_1 = (H_T_H + (P / meas_cov).inverse()).inverse();
+    return K_1.block<DIM_STATE, 6>(0, 0);
+}
+
+int main(int argc, char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 2000;
+    std::mt19937 rng(43);
+    srand(43);
+    int fail = 0;
+    printf("%-16s %6s %12s %12s %11s %10s %10s %8s\n", "case", "num", "max rel err", "tolerance", "factorized", "dense us", "info us",
+           "speedup");
+    for (int type = 0; type < INFO_CASE_NUM; type++)
+    {
+        double max_err = 0, time_dense = 0, time_info = 0;
+        int factorized = 0;
+        for (int n = 0; n < num; n++)
+        {
+            MD(DIM_STATE, DIM_STATE) P;
+            MD(6, 6) HTH;
+            double meas_cov;
+            make_case(rng, type, P, HTH, meas_cov);
+
+            MD(DIM_STATE, 6) K_dense, K_info;
+            double t0 = omp_get_wtime();
+            for (int it = 0; it < INFO_ITER_NUM; it++)
+                K_dense = dense_gain(P, HTH, meas_cov);
+            double t1 = omp_get_wtime();
+            InfoFormSolver solver;
+            solver.set_prior(P, meas_cov);
+            for (int it = 0; it < INFO_ITER_NUM; it++)
+                solver.solve(HTH, K_info);
+            double t2 = omp_get_wtime();
+            time_dense += t1 - t0;
+            time_info += t2 - t1;
+            factorized += solver.factorized;
+            max_err = max(max_err, (K_info - K_dense).norm() / K_dense.norm());
+        }
+        bool ok = max_err <= case_tolerance[type];
+        //; 位姿块不正定时必须每次都走退回分支
+        if (type == INFO_POSE_SINGULAR)
+            ok = ok && factorized == 0;
+        else
+            ok = ok && factorized == num;
+        fail += !ok;
+        printf("%-16s %6d %12.2e %12.0e %11d %10.2f %10.2f %8.2f %s\n", case_name[type], num, max_err, case_tolerance[type], factorized,
+               time_dense / num * 1e6, time_info / num * 1e6, time_dense / time_info, ok ? "" : "<- FAIL");
+    }
+    printf(fail == 0 ? "PASS\n" : "FAIL: %d cases\n", fail);
+    return fail == 0 ? 0 : 1;
+}
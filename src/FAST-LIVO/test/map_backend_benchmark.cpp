@@ -0,0 +1,120 @@
+//; 地图后端对比: ikd-Tree 和 iVox 在同一串合成扫描上的插入耗时、5近邻搜索耗时和近邻质量
+//; 场景是一条走廊(地面、两侧墙、天花板)，传感器沿x轴每帧前进0.5m，和LIO一样先搜索再插入
+//; 用法: map_backend_benchmark [帧数] [每帧扫描点数] [每帧查询点数]
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <lidar_map.h>
+
+#define NUM_MATCH_POINTS (5)
+
+struct BackendStat
+{
+    double insert_time = 0, search_time = 0;
+    long search_num = 0, short_num = 0; //; 查询次数，近邻不足5个的次数
+    vector<float> dist5;                //; 每次查询第5近邻的距离平方，不足5个记-1
+};
+
+static void make_scan(std::mt19937 &rng, double pos_x, int num, PointVector &scan)
+{
+    std::uniform_real_distribution<float> ux(-30.0f, 30.0f), uy(-5.0f, 5.0f), uz(0.0f, 3.0f), uw(0.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    scan.resize(num);
+    for (int i = 0; i < num; i++)
+    {
+        PointType &p = scan[i];
+        p.x = pos_x + ux(rng) * (0.2f + 0.8f * uw(rng)); //; 近处密远处稀
+        float w = uw(rng);
+        if (w < 0.4f)
+        {
+            p.y = uy(rng);
+            p.z = noise(rng);
+        }
+        else if (w < 0.6f)
+        {
+            p.y = uy(rng);
+            p.z = 3.0f + noise(rng);
+        }
+        else
+        {
+            p.y = (w < 0.8f ? -5.0f : 5.0f) + noise(rng);
+            p.z = uz(rng);
+        }
+        p.intensity = i;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int frame_num = argc > 1 ? atoi(argv[1]) : 200;
+    int scan_num = argc > 2 ? atoi(argv[2]) : 20000;
+    int query_num = argc > 3 ? atoi(argv[3]) : 3000;
+    const float map_leaf = 0.3f; //; 和avia_resize.yaml的filter_size_map一样
+
+    LidarMapPtr maps[2] = {LidarMapPtr(new IkdTreeMap()), LidarMapPtr(new IVoxMap(0.5f, NEARBY18))};
+    BackendStat stats[2];
+    for (int m = 0; m < 2; m++)
+        maps[m]->set_downsample_param(map_leaf);
+
+    std::mt19937 rng(7);
+    PointVector scan;
+    for (int f = 0; f < frame_num; f++)
+    {
+        make_scan(rng, 0.5 * f, scan_num, scan);
+        for (int m = 0; m < 2; m++)
+        {
+            LidarMap &map = *maps[m];
+            BackendStat &st = stats[m];
+            if (map.empty())
+            {
+                map.Build(scan);
+                continue;
+            }
+            PointVector points_near;
+            vector<float> sq_dis(NUM_MATCH_POINTS);
+            double t0 = omp_get_wtime();
+            for (int i = 0; i < query_num; i++)
+            {
+                map.Nearest_Search(scan[i], NUM_MATCH_POINTS, points_near, sq_dis);
+                bool full = points_near.size() >= NUM_MATCH_POINTS;
+                st.short_num += full ? 0 : 1;
+                st.dist5.push_back(full ? sq_dis[NUM_MATCH_POINTS - 1] : -1.0f);
+            }
+            st.search_time += omp_get_wtime() - t0;
+            st.search_num += query_num;
+            PointVector scan_add = scan;
+            double t1 = omp_get_wtime();
+            map.Add_Points(scan_add, true);
+            st.insert_time += omp_get_wtime() - t1;
+        }
+    }
+
+    //; iVox只搜近邻体素，是近似搜索；和ikd-Tree的精确结果比较第5近邻的距离
+    long both = 0, worse = 0;
+    double ratio_sum = 0;
+    for (int i = 0; i < stats[0].dist5.size(); i++)
+    {
+        float d_ikd = stats[0].dist5[i], d_ivox = stats[1].dist5[i];
+        if (d_ikd <= 0 || d_ivox <= 0)
+            continue;
+        both++;
+        ratio_sum += sqrt(d_ivox / d_ikd);
+        worse += d_ivox > 1.1f * 1.1f * d_ikd ? 1 : 0;
+    }
+    printf("frames %d, scan points %d, queries per frame %d, map leaf %0.2f m\n", frame_num, scan_num, query_num, map_leaf);
+    for (int m = 0; m < 2; m++)
+    {
+        const BackendStat &st = stats[m];
+        //; ikd-Tree的size()包含还没重建掉的已删除点，按flatten出来的有效点数对比两个地图的密度
+        PointVector map_points;
+        maps[m]->flatten(map_points);
+        printf("%-9s: map points %8zu, insert %7.3f ms/frame, search %6.3f us/query, fewer than %d neighbours %0.4f\n",
+               maps[m]->name(), map_points.size(), st.insert_time / max(frame_num - 1, 1) * 1e3,
+               st.search_time / max(st.search_num, 1L) * 1e6, NUM_MATCH_POINTS, double(st.short_num) / max(st.search_num, 1L));
+    }
+    printf("iVox vs ikd-Tree 5th neighbour distance: mean ratio %0.3f, >10%% farther %0.4f (%ld queries)\n",
+           both > 0 ? ratio_sum / both : 0.0, both > 0 ? double(worse) / both : 0.0, both);
+    return 0;
+}
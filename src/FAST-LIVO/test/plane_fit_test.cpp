@@ -0,0 +1,199 @@
+//; 平面拟合测试: esti_plane_batch(批量闭式解) 和 esti_plane(逐个闭式解) 对比原来的 esti_plane_qr
+//; 每类patch检查有效标志是否一致、平面参数差多少，病态的patch必须退回QR得到完全一样的结果；最后对比三者的耗时
+//; 用法: plane_fit_test [每类patch数]，有不一致时返回1
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <common_lib.h>
+
+#define PLANE_FIT_THRESHOLD (0.1f)
+#define PLANE_FIT_TOLERANCE (1e-3f) //; 和PLANE_FIT_CHECK一样的容差
+
+enum PATCH_TYPE
+{
+    PATCH_PLANE = 0,         //; 普通平面，离原点几十米
+    PATCH_FAR = 1,           //; 离原点几百米，正规方程的条件数最差的正常情况
+    PATCH_THICK = 2,         //; 噪声在阈值附近，有效和无效都有
+    PATCH_NEAR_COLINEAR = 3, //; 5个点几乎在一条线上，垂直方向只有1mm的抖动
+    PATCH_COLINEAR = 4,      //; 严格共线，行列式为0
+    PATCH_DUPLICATE = 5,     //; 5个点重合
+    PATCH_THROUGH_ORIGIN = 6 //; 平面几乎过原点，截距归一化到1的参数化本身是病态的
+};
+const char *patch_name[] = {"plane", "far", "thick", "near-colinear", "colinear", "duplicate", "through-origin"};
+#define PATCH_TYPE_NUM (7)
+
+static void make_patch(std::mt19937 &rng, int type, PointVector &points)
+{
+    std::normal_distribution<float> nd(0.0f, 1.0f);
+    points.resize(NUM_MATCH_POINTS);
+    V3F normal(nd(rng), nd(rng), nd(rng));
+    normal.normalize();
+    V3F u = normal.unitOrthogonal(), v = normal.cross(u);
+    V3F center(nd(rng) * 30.0f, nd(rng) * 30.0f, nd(rng) * 3.0f);
+    if (type == PATCH_FAR)
+        center *= 10.0f;
+    if (type == PATCH_THROUGH_ORIGIN)
+        center = u * nd(rng) * 0.5f + v * nd(rng) * 0.5f + normal * nd(rng) * 1e-3f;
+    float noise = type == PATCH_THICK ? 0.05f : 0.01f;
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+    {
+        V3F p;
+        if (type == PATCH_NEAR_COLINEAR)
+            p = center + u * nd(rng) * 0.5f + v * nd(rng) * 1e-3f;
+        else if (type == PATCH_COLINEAR)
+            p = center + u * float(j) * 0.2f;
+        else if (type == PATCH_DUPLICATE)
+            p = center;
+        else
+            p = center + u * nd(rng) * 0.3f + v * nd(rng) * 0.3f + normal * nd(rng) * noise;
+        points[j].x = p(0);
+        points[j].y = p(1);
+        points[j].z = p(2);
+    }
+}
+
+//; 平面到点的最大距离，判断有效标志的差异是不是只是阈值附近的舍入
+static float max_residual(const VF(4) & pabcd, const PointVector &points)
+{
+    float r = 0;
+    for (int j = 0; j < NUM_MATCH_POINTS; j++)
+        r = max(r, fabsf(pabcd(0) * points[j].x + pabcd(1) * points[j].y + pabcd(2) * points[j].z + pabcd(3)));
+    return r;
+}
+
+static float plane_diff(const VF(4) & a, const VF(4) & b)
+{
+    float diff = 0;
+    for (int k = 0; k < 3; k++)
+        diff = max(diff, fabsf(a(k) - b(k)));
+    return max(diff, fabsf(a(3) - b(3)) / max(1.0f, fabsf(a(3))));
+}
+
+struct PatchStat
+{
+    int num = 0, valid_qr = 0, flag_mismatch = 0, borderline = 0, param_mismatch = 0, fallback_mismatch = 0, false_valid = 0;
+    float max_diff = 0;
+};
+
+int main(int argc, char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 20000;
+    std::mt19937 rng(28);
+    vector<PointVector> patches;
+    vector<int> types;
+    for (int type = 0; type < PATCH_TYPE_NUM; type++)
+    {
+        for (int i = 0; i < num; i++)
+        {
+            patches.emplace_back();
+            make_patch(rng, type, patches.back());
+            types.push_back(type);
+        }
+    }
+    const int total = patches.size();
+
+    //; 批量拟合的结果
+    vector<VF(4)> pabcd_batch(total);
+    vector<bool> valid_batch(total);
+    PlaneFitBatch batch;
+    for (int i = 0; i < total; i += PLANE_FIT_LANES)
+    {
+        batch.lanes = min(PLANE_FIT_LANES, total - i);
+        for (int l = 0; l < batch.lanes; l++)
+            batch.set_lane(l, patches[i + l]);
+        batch.pad();
+        esti_plane_batch(batch, PLANE_FIT_THRESHOLD);
+        for (int l = 0; l < batch.lanes; l++)
+        {
+            valid_batch[i + l] = batch.valid[l];
+            for (int k = 0; k < 4; k++)
+                pabcd_batch[i + l](k) = batch.pabcd[k][l];
+        }
+    }
+
+    PatchStat stat[PATCH_TYPE_NUM];
+    for (int i = 0; i < total; i++)
+    {
+        PatchStat &s = stat[types[i]];
+        const PointVector &points = patches[i];
+        VF(4) pabcd_qr, pabcd_closed;
+        bool valid_qr = esti_plane_qr(pabcd_qr, points, PLANE_FIT_THRESHOLD);
+        bool valid_closed = esti_plane(pabcd_closed, points, PLANE_FIT_THRESHOLD);
+        s.num++;
+        s.valid_qr += valid_qr;
+        //; 有效就说明所有点都在阈值内，这一条不管什么patch都必须成立
+        if (valid_batch[i] && !(max_residual(pabcd_batch[i], points) <= PLANE_FIT_THRESHOLD))
+            s.false_valid++;
+        if (types[i] == PATCH_COLINEAR || types[i] == PATCH_DUPLICATE)
+        {
+            //; 行列式为0，两个闭式解版本都必须退回QR，结果逐位相同
+            if (valid_batch[i] != valid_qr || valid_closed != valid_qr || plane_diff(pabcd_batch[i], pabcd_qr) != 0 ||
+                plane_diff(pabcd_closed, pabcd_qr) != 0)
+                s.fallback_mismatch++;
+            continue;
+        }
+        if (valid_batch[i] != valid_qr || valid_closed != valid_qr)
+        {
+            float r = max_residual(pabcd_qr, points);
+            if (fabsf(r - PLANE_FIT_THRESHOLD) < PLANE_FIT_TOLERANCE * PLANE_FIT_THRESHOLD)
+                s.borderline++;
+            else
+                s.flag_mismatch++;
+            continue;
+        }
+        if (!valid_qr)
+            continue;
+        float diff = max(plane_diff(pabcd_batch[i], pabcd_qr), plane_diff(pabcd_closed, pabcd_qr));
+        s.max_diff = max(s.max_diff, diff);
+        if (diff > PLANE_FIT_TOLERANCE)
+            s.param_mismatch++;
+    }
+
+    //; 近似共线的patch平面本身不确定(绕着那条线转都能拟合)，只要求自洽，不要求和QR一致
+    int fail = 0;
+    printf("%-15s %7s %8s %9s %10s %9s %9s %11s %9s\n", "patch", "num", "valid", "flag diff", "borderline", "param diff", "max diff",
+           "fallback", "false ok");
+    for (int type = 0; type < PATCH_TYPE_NUM; type++)
+    {
+        const PatchStat &s = stat[type];
+        printf("%-15s %7d %8d %9d %10d %9d %9.2e %11d %9d\n", patch_name[type], s.num, s.valid_qr, s.flag_mismatch, s.borderline,
+               s.param_mismatch, s.max_diff, s.fallback_mismatch, s.false_valid);
+        fail += s.false_valid + s.fallback_mismatch;
+        if (type != PATCH_NEAR_COLINEAR)
+            fail += s.flag_mismatch + s.param_mismatch;
+    }
+
+    //; 耗时只用正常的平面patch，和LIO里的情况一样
+    const int bench_num = num;
+    const int repeat = 20;
+    int count_qr = 0, count_closed = 0, count_batch = 0;
+    VF(4) pabcd;
+    double t0 = omp_get_wtime();
+    for (int r = 0; r < repeat; r++)
+        for (int i = 0; i < bench_num; i++)
+            count_qr += esti_plane_qr(pabcd, patches[i], PLANE_FIT_THRESHOLD);
+    double t1 = omp_get_wtime();
+    for (int r = 0; r < repeat; r++)
+        for (int i = 0; i < bench_num; i++)
+            count_closed += esti_plane(pabcd, patches[i], PLANE_FIT_THRESHOLD);
+    double t2 = omp_get_wtime();
+    for (int r = 0; r < repeat; r++)
+        for (int i = 0; i < bench_num; i += PLANE_FIT_LANES)
+        {
+            batch.lanes = min(PLANE_FIT_LANES, bench_num - i);
+            for (int l = 0; l < batch.lanes; l++)
+                batch.set_lane(l, patches[i + l]);
+            batch.pad();
+            esti_plane_batch(batch, PLANE_FIT_THRESHOLD);
+            for (int l = 0; l < batch.lanes; l++)
+                count_batch += batch.valid[l];
+        }
+    double t3 = omp_get_wtime();
+    double n = double(bench_num) * repeat;
+    printf("time per patch: qr %.1f ns, closed form %.1f ns (x%.2f), batch %.1f ns (x%.2f), valid %d/%d/%d\n", (t1 - t0) / n * 1e9,
+           (t2 - t1) / n * 1e9, (t1 - t0) / (t2 - t1), (t3 - t2) / n * 1e9, (t1 - t0) / (t3 - t2), count_qr, count_closed,
+           count_batch);
+    printf(fail == 0 ? "PASS\n" : "FAIL: %d mismatches\n", fail);
+    return fail == 0 ? 0 : 1;
+}
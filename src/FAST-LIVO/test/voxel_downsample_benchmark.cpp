@@ -0,0 +1,106 @@
+//; 降采样对比: VoxelDownsample 和 pcl::VoxelGrid 在同样的点云和体素大小下的耗时、输出点数和质心偏差
+//; 点云是一帧合成的机械式雷达扫描(地面+两侧墙+随机障碍)，近处密远处稀
+//; 用法: voxel_downsample_benchmark [每帧点数] [线程数] [重复次数]
+#include <omp.h>
+#include <random>
+#include <cstdio>
+#include <cstdlib>
+#include <pcl/filters/voxel_grid.h>
+#include "voxel_downsample.h"
+
+static void make_scan(std::mt19937 &rng, int num, PointCloudXYZI &scan)
+{
+    std::uniform_real_distribution<float> ua(-M_PI, M_PI), ue(-0.26f, 0.26f), uw(0.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.02f);
+    scan.clear();
+    scan.points.reserve(num);
+    while (scan.points.size() < num)
+    {
+        float a = ua(rng), e = ue(rng);
+        V3D dir(cos(e) * cos(a), cos(e) * sin(a), sin(e));
+        //; 射线先打到哪个面: 地面z=-1.5，两侧墙y=±8，障碍物随机在5~60m
+        double range = 60.0 * (0.08 + 0.92 * uw(rng));
+        if (dir(2) < 0)
+            range = min(range, -1.5 / dir(2));
+        if (fabs(dir(1)) > 1e-3)
+            range = min(range, 8.0 / fabs(dir(1)));
+        PointType p;
+        p.x = dir(0) * range + noise(rng);
+        p.y = dir(1) * range + noise(rng);
+        p.z = dir(2) * range + noise(rng);
+        p.intensity = 100.0f * uw(rng);
+        p.normal_x = p.normal_y = p.normal_z = 0.0f;
+        p.curvature = 0.0f;
+        scan.points.push_back(p);
+    }
+    scan.width = scan.points.size();
+    scan.height = 1;
+}
+
+int main(int argc, char **argv)
+{
+    int num = argc > 1 ? atoi(argv[1]) : 100000;
+    int thread_num = argc > 2 ? atoi(argv[2]) : 4;
+    int repeat = argc > 3 ? atoi(argv[3]) : 50;
+    std::mt19937 rng(7);
+    PointCloudXYZI::Ptr scan(new PointCloudXYZI());
+    make_scan(rng, num, *scan);
+
+    TaskScheduler scheduler;
+    scheduler.init(thread_num, std::vector<int>());
+    printf("scan points %d, threads %d, repeat %d\n", num, scheduler.thread_num(), repeat);
+
+    const float leaf_sizes[3] = {0.2f, 0.5f, 1.0f};
+    for (int l = 0; l < 3; l++)
+    {
+        float leaf = leaf_sizes[l];
+        pcl::VoxelGrid<PointType> pcl_filter;
+        pcl_filter.setLeafSize(leaf, leaf, leaf);
+        pcl_filter.setInputCloud(scan);
+        PointCloudXYZI pcl_out;
+        double t0 = omp_get_wtime();
+        for (int r = 0; r < repeat; r++)
+            pcl_filter.filter(pcl_out);
+        double pcl_time = (omp_get_wtime() - t0) / repeat;
+
+        VoxelDownsample filter;
+        filter.setLeafSize(leaf, leaf, leaf);
+        filter.setInputCloud(scan);
+        PointCloudXYZI out, out_mt;
+        t0 = omp_get_wtime();
+        for (int r = 0; r < repeat; r++)
+            filter.filter(out);
+        double time_1t = (omp_get_wtime() - t0) / repeat;
+        filter.set_scheduler(&scheduler);
+        t0 = omp_get_wtime();
+        for (int r = 0; r < repeat; r++)
+            filter.filter(out_mt);
+        double time_mt = (omp_get_wtime() - t0) / repeat;
+
+        //; 两边的体素划分一样(都是floor(p / leaf))，按体素对比质心
+        unordered_map<VOXEL_KEY, V3D> pcl_centroid;
+        for (int i = 0; i < pcl_out.size(); i++)
+        {
+            const PointType &p = pcl_out.points[i];
+            pcl_centroid[VOXEL_KEY(floor(p.x / leaf), floor(p.y / leaf), floor(p.z / leaf))] = V3D(p.x, p.y, p.z);
+        }
+        double max_diff = 0;
+        int missing = 0;
+        for (int i = 0; i < out_mt.size(); i++)
+        {
+            const PointType &p = out_mt.points[i];
+            auto iter = pcl_centroid.find(VOXEL_KEY(floor(p.x / leaf), floor(p.y / leaf), floor(p.z / leaf)));
+            if (iter == pcl_centroid.end())
+            {
+                missing++;
+                continue;
+            }
+            max_diff = max(max_diff, (iter->second - V3D(p.x, p.y, p.z)).norm());
+        }
+        printf("leaf %.1f: pcl %zu pts %.3f ms | ours %zu pts, 1 thread %.3f ms (x%.2f), %d threads %.3f ms (x%.2f) | "
+               "voxels not in pcl %d, max centroid diff %.2e m\n",
+               leaf, pcl_out.size(), pcl_time * 1e3, out_mt.size(), time_1t * 1e3, pcl_time / time_1t, scheduler.thread_num(),
+               time_mt * 1e3, pcl_time / time_mt, missing, max_diff);
+    }
+    return 0;
+}